@@ -0,0 +1,84 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "dist.h"
+#include "timing.h"
+
+#define MAX_SERVICE_NS 1000000000.0 /* cap for heavy-tailed draws */
+#define SPIN_BELOW_NS 10000         /* shorter work is always busy-spun */
+
+int dist_parse(const char *spec, struct dist *out)
+{
+     double x = 0, y = 0, z = 0;
+     char extra;
+     memset(out, 0, sizeof(*out));
+
+     if (strcmp(spec, "none") == 0)
+          return 0;
+     if (sscanf(spec, "const:%lf%c", &x, &extra) == 1 && x >= 0)
+          *out = (struct dist){DIST_CONSTANT, x * 1000, 0, 0};
+     else if (sscanf(spec, "uniform:%lf%c", &x, &extra) == 1 && x > 0)
+          *out = (struct dist){DIST_UNIFORM, x * 1000, 0, 0};
+     else if (sscanf(spec, "exp:%lf%c", &x, &extra) == 1 && x > 0)
+          *out = (struct dist){DIST_EXPONENTIAL, x * 1000, 0, 0};
+     else if (sscanf(spec, "lognormal:%lf:%lf%c", &x, &y, &extra) == 2 && x > 0 && y >= 0)
+          *out = (struct dist){DIST_LOGNORMAL, x * 1000, y, 0};
+     else if (sscanf(spec, "pareto:%lf:%lf%c", &x, &y, &extra) == 2 && x > 0 && y > 0)
+          *out = (struct dist){DIST_PARETO, x * 1000, y, 0};
+     else if (sscanf(spec, "bimodal:%lf:%lf:%lf%c", &x, &y, &z, &extra) == 3 &&
+              x >= 0 && y >= 0 && z >= 0 && z <= 1)
+          *out = (struct dist){DIST_BIMODAL, x * 1000, y * 1000, z};
+     else
+          return -1;
+     return 0;
+}
+
+uint64_t dist_sample_ns(const struct dist *d, struct rng *r)
+{
+     double v = 0;
+     switch (d->kind)
+     {
+     case DIST_NONE:
+          return 0;
+     case DIST_CONSTANT:
+          v = d->a;
+          break;
+     case DIST_UNIFORM:
+          v = (1.0 - rng_uniform(r)) * d->a;
+          break;
+     case DIST_EXPONENTIAL:
+          v = rng_exponential(r, d->a);
+          break;
+     case DIST_LOGNORMAL:
+     {
+          /* Box-Muller; mu chosen so the mean comes out as requested */
+          double z = sqrt(-2.0 * log(rng_uniform(r))) * cos(2.0 * M_PI * rng_uniform(r));
+          double mu = log(d->a) - d->b * d->b / 2.0;
+          v = exp(mu + d->b * z);
+          break;
+     }
+     case DIST_PARETO:
+          v = d->a / pow(rng_uniform(r), 1.0 / d->b);
+          break;
+     case DIST_BIMODAL:
+          v = rng_uniform(r) <= d->p ? d->b : d->a;
+          break;
+     }
+     return v < MAX_SERVICE_NS ? (uint64_t)v : (uint64_t)MAX_SERVICE_NS;
+}
+
+void dist_work(uint64_t ns, bool spin)
+{
+     if (ns == 0)
+          return;
+     if (spin || ns < SPIN_BELOW_NS)
+     {
+          uint64_t end = timing_now_ns() + ns;
+          while (timing_now_ns() < end)
+               ;
+          return;
+     }
+     struct timespec s = {(time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull)};
+     nanosleep(&s, NULL);
+}
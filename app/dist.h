@@ -0,0 +1,57 @@
+#ifndef DIST_H
+#define DIST_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "rng.h"
+
+/*
+ * Service time distributions for simulated producing/consuming work.
+ * Specs are written kind:params with times in microseconds:
+ *
+ *   none                    no work
+ *   const:T                 always T
+ *   uniform:MAX             uniform in [0, MAX) (what -d uses, MAX = 1000)
+ *   exp:MEAN                exponential
+ *   lognormal:MEAN:SIGMA    lognormal with the given mean and log-space sigma
+ *   pareto:MIN:ALPHA        Pareto with scale MIN and shape ALPHA
+ *   bimodal:FAST:SLOW:P     FAST, or SLOW with probability P
+ */
+enum dist_kind
+{
+     DIST_NONE = 0,
+     DIST_CONSTANT,
+     DIST_UNIFORM,
+     DIST_EXPONENTIAL,
+     DIST_LOGNORMAL,
+     DIST_PARETO,
+     DIST_BIMODAL,
+};
+
+struct dist
+{
+     enum dist_kind kind;
+     double a; /*first parameter, in ns for times*/
+     double b; /*second parameter*/
+     double p; /*bimodal probability of the slow mode*/
+};
+
+/**
+ * @brief Parse a distribution spec as described above.
+ *
+ * @return 0 on success, -1 if @p spec is not understood
+ */
+int dist_parse(const char *spec, struct dist *out);
+
+/**
+ * @brief Draw one service time in nanoseconds, capped at one second.
+ */
+uint64_t dist_sample_ns(const struct dist *d, struct rng *r);
+
+/**
+ * @brief Spend @p ns nanoseconds of simulated work. Busy-spins when
+ * @p spin is set or the time is under 10us, where nanosleep cannot be
+ * accurate; sleeps otherwise.
+ */
+void dist_work(uint64_t ns, bool spin);
+
+#endif
@@ -0,0 +1,71 @@
+#include <string.h>
+#include "histogram.h"
+
+void hist_init(histogram_t *h)
+{
+     memset(h, 0, sizeof(*h));
+     h->min = UINT64_MAX;
+}
+
+static unsigned bucket_of(uint64_t v)
+{
+     if (v < HIST_SUB_BUCKETS)
+          return (unsigned)v;
+     unsigned shift = (63 - __builtin_clzll(v)) - (HIST_SUB_BITS - 1);
+     return HIST_SUB_BUCKETS + (shift - 1) * HIST_HALF_BUCKETS +
+            (unsigned)((v >> shift) - HIST_HALF_BUCKETS);
+}
+
+/* largest value that maps to bucket i */
+static uint64_t bucket_upper(unsigned i)
+{
+     if (i < HIST_SUB_BUCKETS)
+          return i;
+     unsigned shift = (i - HIST_SUB_BUCKETS) / HIST_HALF_BUCKETS + 1;
+     uint64_t sub = (i - HIST_SUB_BUCKETS) % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS;
+     return ((sub + 1) << shift) - 1;
+}
+
+void hist_record(histogram_t *h, uint64_t v)
+{
+     h->counts[bucket_of(v)]++;
+     h->total++;
+     if (v < h->min)
+          h->min = v;
+     if (v > h->max)
+          h->max = v;
+}
+
+void hist_merge(histogram_t *dst, const histogram_t *src)
+{
+     for (unsigned i = 0; i < HIST_BUCKETS; i++)
+          dst->counts[i] += src->counts[i];
+     dst->total += src->total;
+     if (src->min < dst->min)
+          dst->min = src->min;
+     if (src->max > dst->max)
+          dst->max = src->max;
+}
+
+uint64_t hist_percentile(const histogram_t *h, double p)
+{
+     if (h->total == 0)
+          return 0;
+     uint64_t rank = (uint64_t)(p / 100.0 * (double)h->total + 0.5);
+     if (rank < 1)
+          rank = 1;
+     if (rank > h->total)
+          rank = h->total;
+
+     uint64_t seen = 0;
+     for (unsigned i = 0; i < HIST_BUCKETS; i++)
+     {
+          seen += h->counts[i];
+          if (seen >= rank)
+          {
+               uint64_t v = bucket_upper(i);
+               return v > h->max ? h->max : v;
+          }
+     }
+     return h->max;
+}
@@ -0,0 +1,46 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <stdint.h>
+
+/*
+ * Log-linear (HDR style) histogram of non-negative integer samples.
+ * Values below HIST_SUB_BUCKETS are recorded exactly; above that every
+ * power of two is split into HIST_SUB_BUCKETS / 2 linear buckets, which
+ * keeps the relative error under 1/64 over the whole 64-bit range.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_HALF_BUCKETS (HIST_SUB_BUCKETS / 2)
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (64 - HIST_SUB_BITS) * HIST_HALF_BUCKETS)
+
+typedef struct
+{
+     uint64_t counts[HIST_BUCKETS];
+     uint64_t total;
+     uint64_t min;
+     uint64_t max;
+} histogram_t;
+
+/**
+ * @brief Reset a histogram to hold no samples.
+ */
+void hist_init(histogram_t *h);
+
+/**
+ * @brief Record one sample.
+ */
+void hist_record(histogram_t *h, uint64_t v);
+
+/**
+ * @brief Add all the samples of @p src to @p dst.
+ */
+void hist_merge(histogram_t *dst, const histogram_t *src);
+
+/**
+ * @brief Value at percentile @p p (0-100). The result is the upper edge of
+ * the bucket holding that sample, capped at the recorded maximum. Returns 0
+ * for an empty histogram.
+ */
+uint64_t hist_percentile(const histogram_t *h, double p);
+
+#endif
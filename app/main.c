@@ -1,158 +1,100 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include <unistd.h>
 #include <stdbool.h>
-#include <time.h>
-#include <sys/time.h> /* for gettimeofday system call */
-#include "../src/lab.h"
-
-#define UNUSED(x) (void)x
-#define MAX_C 8           /* Maximum number of consumer threads */
-#define MAX_P 8           /* Maximum number of producer threads */
-#define MAX_SLEEP 1000000 /* maximum time a thread can sleep in nanoseconds*/
-
-static bool delay = false;
-
-double getMilliSeconds()
-{
-     struct timeval now;
-     gettimeofday(&now, (struct timezone *)0);
-     return (double)now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
-}
-
-/*Track the total items produced and consumed*/
-static struct
-{
-     unsigned int num;
-     pthread_mutex_t lock;
-} numproduced = {0, PTHREAD_MUTEX_INITIALIZER},
-  numconsumed = {0, PTHREAD_MUTEX_INITIALIZER};
-
-/*Shared queue that producers and consumers will access*/
-static queue_t pc_queue;
-
-/**
- * Produces items at a random interval. Exits once it has produced
- * the correct number of items.
- */
-static void *producer(void *args)
-{
-
-     int num = *((int *)args);
-     //pthread_t tid = pthread_self();
-     unsigned int seedp = 0;
-     struct timespec s = {0, 0};
-     int *itm = NULL;
-
-     // fprintf(stderr, "Producer thread: %ld - producing %d items\n", tid, num);
-     for (int i = 0; i < num; i++)
-     {
-          if (delay)
-          {
-               /*simulate producing the item*/
-               s.tv_nsec = (rand_r(&seedp) % MAX_SLEEP);
-               nanosleep(&s, NULL);
-          }
-
-          itm = (int *)malloc(sizeof(int));
-          *itm = i;
-          // Put the item into the queue
-          enqueue(pc_queue, itm);
-
-          // Update counters for testing purposes
-          pthread_mutex_lock(&numproduced.lock);
-          numproduced.num++;
-          pthread_mutex_unlock(&numproduced.lock);
-     }
-     // fprintf(stderr, "Producer thread: %ld - Done producing!\n", tid);
-     pthread_exit(NULL);
-}
-
-/**
- * Consumes items.
- */
-static void *consumer(void *args)
-{
-     UNUSED(args);
-     //pthread_t tid = pthread_self();
-     unsigned int seedp = 0;
-     struct timespec s = {0, 0};
-     int *itm = NULL;
-     // fprintf(stderr, "Consumer thread: %ld\n", tid);
-
-     while (true)
-     {
-          if (delay)
-          {
-               /*simulate producing the item*/
-               s.tv_nsec = (rand_r(&seedp) % MAX_SLEEP);
-               nanosleep(&s, NULL);
-          }
-
-          itm = (int *)dequeue(pc_queue);
-          if (itm)
-          {
-               free(itm);
-               itm = NULL;
-               // Update counters for testing purposes
-               pthread_mutex_lock(&numconsumed.lock);
-               numconsumed.num++;
-               pthread_mutex_unlock(&numconsumed.lock);
-          }
-          else
-          {
-               // If the queue is implemented correctly we should not
-               // get a NULL item during normal operation. It is possible to
-               // get a NULL item AFTER shutdown has been called which is fine
-               // because we are just cleaning up all the items.
-               if (!is_shutdown(pc_queue))
-               {
-                    fprintf(stderr, "ERROR: Got a null item when queue was not shutdown!\n");
-               }
-               break;
-          }
-     }
-     // fprintf(stderr, "Consumer Thread: %ld - Done consuming!\n", tid);
-     pthread_exit(NULL);
-}
+#include <string.h>
+#include "sim.h"
+#include "sweep.h"
+#include "timing.h"
 
 static void usage(char *n)
 {
-     fprintf(stderr, "Usage: %s [-c num consumer] [-p num producer] [-i num items] [-s queue size] <-d introduce delay>\n", n);
-     fprintf(stderr, "-d will introduce a random delay between consumer and producer");
+     fprintf(stderr, "Usage: %s [-c num consumer|auto] [-p num producer|auto] [-i num items] [-s queue size] [-b batch size] [-a placement] [-r items/sec] [-A constant|poisson] [-P dist] [-C dist] [-S seed] [-w] <-d introduce delay>\n", n);
+     fprintf(stderr, "       %s -B sweep.conf\n", n);
+     fprintf(stderr, "auto for -c/-p uses half of the available CPUs for each\n");
+     fprintf(stderr, "-a pins threads: compact, scatter, smt, l3, cross or a CPU list like 0,2,4-7 (see app/topology.h)\n");
+     fprintf(stderr, "-r runs open loop at the given total arrival rate, -A picks the inter-arrival distribution;\n");
+     fprintf(stderr, "   latency is then measured from each item's intended send time\n");
+     fprintf(stderr, "-d will introduce a random delay between consumer and producer (same as -P uniform:1000 -C uniform:1000)\n");
+     fprintf(stderr, "-P/-C set producer/consumer service times in us: const:T, uniform:MAX, exp:MEAN,\n");
+     fprintf(stderr, "   lognormal:MEAN:SIGMA, pareto:MIN:ALPHA, bimodal:FAST:SLOW:P (see app/dist.h)\n");
+     fprintf(stderr, "-S seeds the per-thread generators, -w busy-spins service times instead of sleeping\n");
+     fprintf(stderr, "-B runs the parameter sweep described in the given config file (see app/sweep.h)\n");
      exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
-     int nump = 1;       /*total number of producers*/
-     int numc = 1;       /*total number of consumers*/
-     int numitems = 10;  /*total number of items to produce per thread*/
-     int queue_size = 5; /*The default size of the queue*/
+     struct sim_config cfg = {
+         .producers = 1,  /*total number of producers*/
+         .consumers = 1,  /*total number of consumers*/
+         .items = 10,     /*total number of items to produce*/
+         .queue_size = 5, /*The default size of the queue*/
+         .batch = 1,      /*single enqueue/dequeue calls*/
+         .seed = 1,
+     };
+     const char *sweep_conf = NULL;
+     static struct placement placement;
      int c;
 
-     pthread_t producers[MAX_P];
-     pthread_t consumers[MAX_C];
-
-     while ((c = getopt(argc, argv, "c:p:i:s:dh")) != -1)
+     while ((c = getopt(argc, argv, "c:p:i:s:b:B:a:r:A:P:C:S:wdh")) != -1)
           switch (c)
           {
           case 'c':
-               numc = atoi(optarg);
+               if ((cfg.consumers = sim_parse_threads(optarg)) < 0)
+                    usage(argv[0]);
                break;
           case 'p':
-               nump = atoi(optarg);
-               ;
+               if ((cfg.producers = sim_parse_threads(optarg)) < 0)
+                    usage(argv[0]);
                break;
           case 'i':
-               numitems = atoi(optarg);
+               cfg.items = atoi(optarg);
                break;
           case 's':
-               queue_size = atoi(optarg);
+               cfg.queue_size = atoi(optarg);
+               break;
+          case 'b':
+               cfg.batch = atoi(optarg);
+               break;
+          case 'a':
+               if (placement_parse(optarg, &placement) != 0)
+                    usage(argv[0]);
+               cfg.placement = &placement;
+               break;
+          case 'r':
+               cfg.rate = atof(optarg);
+               if (cfg.rate <= 0)
+                    usage(argv[0]);
+               break;
+          case 'A':
+               if (strcmp(optarg, "poisson") == 0)
+                    cfg.arrival = ARRIVAL_POISSON;
+               else if (strcmp(optarg, "constant") == 0)
+                    cfg.arrival = ARRIVAL_CONSTANT;
+               else
+                    usage(argv[0]);
+               break;
+          case 'P':
+               if (dist_parse(optarg, &cfg.produce) != 0)
+                    usage(argv[0]);
+               break;
+          case 'C':
+               if (dist_parse(optarg, &cfg.consume) != 0)
+                    usage(argv[0]);
+               break;
+          case 'S':
+               cfg.seed = strtoull(optarg, NULL, 0);
+               break;
+          case 'w':
+               cfg.spin = true;
+               break;
+          case 'B':
+               sweep_conf = optarg;
                break;
           case 'd':
-               delay = true;
+               dist_parse("uniform:1000", &cfg.produce);
+               dist_parse("uniform:1000", &cfg.consume);
                break;
           case 'h':
                usage(argv[0]);
@@ -160,65 +102,51 @@ int main(int argc, char *argv[])
           default: /* ? */
                usage(argv[0]);
           }
-     if (numc > MAX_C)
-          numc = MAX_C;
-     if (nump > MAX_P)
-          nump = MAX_P;
 
-     int per_thread = numitems / nump;
-     fprintf(stderr, "Simulating %d producers %d consumers with %d items per thread and a queue size of %d\n", nump, numc, per_thread, queue_size);
-     // Start our timing
-     double end = 0;
-     double start = getMilliSeconds();
+     if (sweep_conf)
+          return sweep_run(sweep_conf) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 
-     // Initialize the queue for usage
-     pc_queue = queue_init(queue_size);
-     /*Create the producer threads*/
-     for (int i = 0; i < nump; i++)
-     {
-          pthread_create(&producers[i], NULL, producer, (void *)&per_thread);
-     }
+     int per_thread = cfg.items / cfg.producers;
+     fprintf(stderr, "Simulating %d producers %d consumers with %d items per thread and a queue size of %d\n",
+             cfg.producers, cfg.consumers, per_thread, cfg.queue_size);
 
-     fprintf(stderr, "Creating %d consumer threads\n", numc);
-     /*Create the consumer threads*/
-     for (int i = 0; i < numc; i++)
+     struct sim_result *res = (struct sim_result *)malloc(sizeof(struct sim_result));
+     if (!res || sim_run(&cfg, res) != 0)
      {
-          pthread_create(&consumers[i], NULL, consumer, (void *)NULL);
+          fprintf(stderr, "ERROR: could not set up the simulation\n");
+          exit(EXIT_FAILURE);
      }
 
-     /*Wait for all the the producer threads to finish*/
-     for (int i = 0; i < nump; i++)
+     if (res->produced != res->consumed)
      {
-          pthread_join(producers[i], NULL);
-     }
-
-     // Once all the producers are finished we set a flag so the consumer thread can finish up
-     // Once shutdown is called your queue should drain all remaining items and be read for
-     // destruction!
-     queue_shutdown(pc_queue);
-
-     /*Wait for all the the consumer threads to finish*/
-     for (int i = 0; i < numc; i++)
-     {
-          pthread_join(consumers[i], NULL);
+          fprintf(stderr, "ERROR! produced != consumed\n");
+          abort();
      }
-
-     if (numproduced.num != numconsumed.num)
+     if (!res->checksum_ok)
      {
-          fprintf(stderr, "ERROR! produced != consumed\n");
+          fprintf(stderr, "ERROR! checksum of consumed items does not match produced\n");
           abort();
      }
-     fprintf(stderr, "Queue is empty:%s\n", is_empty(pc_queue) ? "true" : "false");
-     fprintf(stderr, "Total produced:%d\n", numproduced.num);
-     fprintf(stderr, "Total consumed:%d\n", numconsumed.num);
-
-     // Free up all the stuff we allocated
-     queue_destroy(pc_queue);
+     fprintf(stderr, "Queue is empty:%s\n", res->empty_at_end ? "true" : "false");
+     fprintf(stderr, "Total produced:%d\n", res->produced);
+     fprintf(stderr, "Total consumed:%d\n", res->consumed);
+     fprintf(stderr, "Phases (ms): setup %.3f steady %.3f drain %.3f [clock: %s]\n",
+             res->setup_ms, res->steady_ms, res->drain_ms, timing_source());
+     fprintf(stderr, "Throughput: %.1f items/s\n",
+             res->elapsed_ms > 0 ? res->produced / (res->elapsed_ms / 1000.0) : 0.0);
+     if (cfg.rate > 0)
+          fprintf(stderr, "Offered load: %.1f items/s (%s arrivals)\n",
+                  cfg.rate, cfg.arrival == ARRIVAL_POISSON ? "poisson" : "constant");
+     fprintf(stderr, "Latency (us): p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f\n",
+             hist_percentile(&res->latency, 50.0) / 1000.0,
+             hist_percentile(&res->latency, 90.0) / 1000.0,
+             hist_percentile(&res->latency, 99.0) / 1000.0,
+             hist_percentile(&res->latency, 99.9) / 1000.0,
+             res->latency.max / 1000.0);
 
-     // End our timing
-     end = getMilliSeconds();
      // Print timing to standard out to graph
-     fprintf(stdout, " %f %d \n", end - start, numproduced.num);
+     fprintf(stdout, " %f %d \n", res->elapsed_ms, res->produced);
 
+     free(res);
      return 0;
 }
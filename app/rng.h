@@ -0,0 +1,34 @@
+#ifndef RNG_H
+#define RNG_H
+#include <stdint.h>
+
+/*
+ * Small per-thread random number generator (xoshiro256**), seeded through
+ * splitmix64 so that nearby seeds give unrelated streams.
+ */
+struct rng
+{
+     uint64_t s[4];
+};
+
+/**
+ * @brief Seed @p r. Threads should use distinct seeds, e.g. base + index.
+ */
+void rng_seed(struct rng *r, uint64_t seed);
+
+/**
+ * @brief Next 64 random bits.
+ */
+uint64_t rng_next(struct rng *r);
+
+/**
+ * @brief Uniform double in (0, 1], never 0 so it is safe to take its log.
+ */
+double rng_uniform(struct rng *r);
+
+/**
+ * @brief Exponentially distributed value with the given mean.
+ */
+double rng_exponential(struct rng *r, double mean);
+
+#endif
@@ -0,0 +1,466 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/lab.h"
+#include "dist.h"
+#include "rng.h"
+#include "sim.h"
+#include "timing.h"
+#include "topology.h"
+
+#define SPIN_NS 100000    /* closer than this to a deadline we spin instead of sleeping */
+
+static double ms_between(uint64_t from_ns, uint64_t to_ns)
+{
+     return (double)(to_ns - from_ns) / 1e6;
+}
+
+/*
+ * Per-thread tally of items produced or consumed plus a checksum of their
+ * values. Each thread owns one on its own cache line; they are only added
+ * up after the threads are joined.
+ */
+struct tally
+{
+     uint64_t num;
+     uint64_t checksum;
+} __attribute__((aligned(64)));
+
+/*
+ * Start line for the threads of one run. Unlike a barrier it can be opened
+ * with fewer threads than planned, so a run whose thread creation fails
+ * part way can send the ones already started home.
+ */
+struct gate
+{
+     pthread_mutex_t lock;
+     pthread_cond_t cond;
+     int arrived;    /*threads waiting at the gate*/
+     bool open;
+     bool cancelled; /*opened to abandon the run, not to start it*/
+};
+
+/*Wait at the gate; returns false if the run was abandoned*/
+static bool gate_wait(struct gate *g)
+{
+     pthread_mutex_lock(&g->lock);
+     g->arrived++;
+     pthread_cond_broadcast(&g->cond);
+     while (!g->open)
+          pthread_cond_wait(&g->cond, &g->lock);
+     bool go = !g->cancelled;
+     pthread_mutex_unlock(&g->lock);
+     return go;
+}
+
+/*Open the gate once n threads wait at it, or at once to cancel the run*/
+static void gate_open(struct gate *g, int n, bool cancel)
+{
+     pthread_mutex_lock(&g->lock);
+     while (!cancel && g->arrived < n)
+          pthread_cond_wait(&g->cond, &g->lock);
+     g->open = true;
+     g->cancelled = cancel;
+     pthread_cond_broadcast(&g->cond);
+     pthread_mutex_unlock(&g->lock);
+}
+
+/*State shared by all the threads of one run*/
+struct sim
+{
+     const struct sim_config *cfg;
+     queue_t pc_queue; /*Shared queue that producers and consumers will access*/
+     int per_thread;   /*items each producer makes*/
+     struct gate start; /*releases all threads at once after creation*/
+};
+
+/*What each producer gets: the run, its index and its own tally*/
+struct producer_args
+{
+     struct tally produced;
+     struct sim *sim;
+     int index;
+} __attribute__((aligned(64)));
+
+/*What each consumer gets: the run, its own tally and latency histogram*/
+struct consumer_args
+{
+     struct tally consumed;
+     struct sim *sim;
+     int index;
+     histogram_t latency;
+} __attribute__((aligned(64)));
+
+/*What travels through the queue: a value stamped with its enqueue time*/
+struct item
+{
+     uint64_t value; /*unique across producers*/
+     uint64_t enqueued_ns;
+};
+
+/* order independent checksum term for one item value (splitmix64 finalizer) */
+static uint64_t mix(uint64_t v)
+{
+     v += 0x9e3779b97f4a7c15ull;
+     v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ull;
+     v = (v ^ (v >> 27)) * 0x94d049bb133111ebull;
+     return v ^ (v >> 31);
+}
+
+/* sleep, then spin, until the timing clock reaches deadline_ns */
+static void wait_until(uint64_t deadline_ns)
+{
+     uint64_t now;
+     while ((now = timing_now_ns()) < deadline_ns)
+     {
+          if (deadline_ns - now > SPIN_NS)
+          {
+               struct timespec s = {0, (long)(deadline_ns - now - SPIN_NS / 2)};
+               if (s.tv_nsec >= 1000000000L)
+               {
+                    s.tv_sec = s.tv_nsec / 1000000000L;
+                    s.tv_nsec %= 1000000000L;
+               }
+               nanosleep(&s, NULL);
+          }
+     }
+}
+
+static void count(struct tally *t, uint64_t value)
+{
+     t->num++;
+     t->checksum += mix(value);
+}
+
+/**
+ * Produces items at a random interval. Exits once it has produced
+ * the correct number of items.
+ *
+ * In open-loop mode (cfg->rate > 0) every item has an intended send time
+ * drawn from the arrival process. The producer waits for that time if it is
+ * early and sends at once if it is late, and the item is stamped with the
+ * intended time, so queueing delay caused by a backed up producer still
+ * shows up in the latency (no coordinated omission).
+ */
+static void *producer(void *args)
+{
+     struct producer_args *pa = (struct producer_args *)args;
+     struct sim *sim = pa->sim;
+     int num = sim->per_thread;
+     int batch = sim->cfg->batch;
+     void *pending[batch];
+     int npending = 0;
+     struct rng rng;
+     bool open_loop = sim->cfg->rate > 0;
+     double gap_ns = open_loop ? 1e9 * sim->cfg->producers / sim->cfg->rate : 0.0;
+     double offset_ns = 0.0; /*intended send time relative to the start*/
+
+     rng_seed(&rng, sim->cfg->seed + 2 * (uint64_t)pa->index);
+     if (!gate_wait(&sim->start))
+          pthread_exit(NULL);
+     uint64_t start_ns = timing_now_ns();
+
+     for (int i = 0; i < num; i++)
+     {
+          /*simulate producing the item*/
+          dist_work(dist_sample_ns(&sim->cfg->produce, &rng), sim->cfg->spin);
+
+          struct item *itm = (struct item *)malloc(sizeof(struct item));
+          itm->value = (uint64_t)pa->index * num + i;
+          if (open_loop)
+          {
+               offset_ns += sim->cfg->arrival == ARRIVAL_POISSON ? rng_exponential(&rng, gap_ns) : gap_ns;
+               itm->enqueued_ns = start_ns + (uint64_t)offset_ns;
+               wait_until(itm->enqueued_ns);
+          }
+          else
+          {
+               itm->enqueued_ns = timing_now_ns();
+          }
+          count(&pa->produced, itm->value);
+
+          if (batch == 1)
+          {
+               // Put the item into the queue
+               enqueue(sim->pc_queue, itm);
+               continue;
+          }
+
+          pending[npending++] = itm;
+          if (npending == batch || i == num - 1)
+          {
+               enqueue_batch(sim->pc_queue, pending, npending);
+               npending = 0;
+          }
+     }
+     pthread_exit(NULL);
+}
+
+/**
+ * Consumes items, recording each item's enqueue-to-dequeue latency in
+ * its own histogram.
+ */
+static void *consumer(void *args)
+{
+     struct consumer_args *ca = (struct consumer_args *)args;
+     struct sim *sim = ca->sim;
+     int batch = sim->cfg->batch;
+     void *got[batch];
+     struct rng rng;
+
+     rng_seed(&rng, sim->cfg->seed + 2 * (uint64_t)ca->index + 1);
+     if (!gate_wait(&sim->start))
+          pthread_exit(NULL);
+     while (true)
+     {
+          /*simulate consuming the item*/
+          dist_work(dist_sample_ns(&sim->cfg->consume, &rng), sim->cfg->spin);
+
+          int n;
+          if (batch == 1)
+          {
+               got[0] = dequeue(sim->pc_queue);
+               n = got[0] ? 1 : 0;
+          }
+          else
+          {
+               n = dequeue_batch(sim->pc_queue, got, batch);
+          }
+
+          if (n > 0)
+          {
+               uint64_t now = timing_now_ns();
+               for (int i = 0; i < n; i++)
+               {
+                    struct item *itm = (struct item *)got[i];
+                    hist_record(&ca->latency, now - itm->enqueued_ns);
+                    // Update counters for testing purposes
+                    count(&ca->consumed, itm->value);
+                    free(itm);
+               }
+          }
+          else
+          {
+               // If the queue is implemented correctly we should not
+               // get a NULL item during normal operation. It is possible to
+               // get a NULL item AFTER shutdown has been called which is fine
+               // because we are just cleaning up all the items.
+               if (!is_shutdown(sim->pc_queue))
+               {
+                    fprintf(stderr, "ERROR: Got a null item when queue was not shutdown!\n");
+               }
+               break;
+          }
+     }
+     pthread_exit(NULL);
+}
+
+int sim_parse_threads(const char *arg)
+{
+     if (strcmp(arg, "auto") == 0)
+     {
+          cpu_set_t set;
+          long ncpu;
+          if (sched_getaffinity(0, sizeof(set), &set) == 0)
+               ncpu = CPU_COUNT(&set);
+          else
+               ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+          return ncpu >= 2 ? (int)(ncpu / 2) : 1;
+     }
+     char *end;
+     long n = strtol(arg, &end, 10);
+     if (*end != '\0' || n < 1 || n > 1000000)
+          return -1;
+     return (int)n;
+}
+
+/* thread attributes pinning to cpu, or the defaults when cpus is NULL */
+static pthread_attr_t *pin_attr(pthread_attr_t *attr, const int *cpus, int i)
+{
+     if (!cpus)
+          return NULL;
+     cpu_set_t set;
+     CPU_ZERO(&set);
+     CPU_SET(cpus[i], &set);
+     pthread_attr_init(attr);
+     pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+     return attr;
+}
+
+int sim_run(const struct sim_config *cfg, struct sim_result *res)
+{
+     int nump = cfg->producers;
+     int numc = cfg->consumers;
+     pthread_t *producers = NULL;
+     pthread_t *consumers = NULL;
+     struct producer_args *pargs = NULL;
+     struct consumer_args *cargs = NULL;
+     int *prod_cpu = NULL;
+     int *cons_cpu = NULL;
+     pthread_attr_t attr;
+     struct sim sim = {.cfg = cfg};
+     int started_p = 0, started_c = 0;
+
+     if (nump < 1 || numc < 1 || cfg->queue_size < 1 || cfg->batch < 1)
+          return -1;
+     sim.per_thread = cfg->items / nump;
+
+     producers = (pthread_t *)malloc(sizeof(pthread_t) * nump);
+     consumers = (pthread_t *)malloc(sizeof(pthread_t) * numc);
+     pargs = (struct producer_args *)aligned_alloc(64, sizeof(struct producer_args) * nump);
+     cargs = (struct consumer_args *)aligned_alloc(64, sizeof(struct consumer_args) * numc);
+     if (!producers || !consumers || !pargs || !cargs)
+          goto fail;
+     if (cfg->placement && cfg->placement->mode != PLACE_NONE)
+     {
+          prod_cpu = (int *)malloc(sizeof(int) * nump);
+          cons_cpu = (int *)malloc(sizeof(int) * numc);
+          if (!prod_cpu || !cons_cpu ||
+              placement_plan(cfg->placement, nump, numc, prod_cpu, cons_cpu) != 0)
+          {
+               fprintf(stderr, "ERROR: this machine cannot satisfy the requested placement\n");
+               goto fail;
+          }
+     }
+     for (int i = 0; i < nump; i++)
+     {
+          pargs[i] = (struct producer_args){.sim = &sim, .index = i};
+     }
+     for (int i = 0; i < numc; i++)
+     {
+          cargs[i].consumed = (struct tally){0, 0};
+          cargs[i].sim = &sim;
+          cargs[i].index = i;
+          hist_init(&cargs[i].latency);
+     }
+
+     // Start our timing
+     timing_init();
+     uint64_t setup_start = timing_now_ns();
+
+     // Initialize the queue for usage
+     sim.pc_queue = queue_init(cfg->queue_size);
+     if (!sim.pc_queue)
+          goto fail;
+     pthread_mutex_init(&sim.start.lock, NULL);
+     pthread_cond_init(&sim.start.cond, NULL);
+     /*Create the producer threads*/
+     for (int i = 0; i < nump; i++)
+     {
+          pthread_attr_t *a = pin_attr(&attr, prod_cpu, i);
+          int rc = pthread_create(&producers[i], a, producer, (void *)&pargs[i]);
+          if (a)
+               pthread_attr_destroy(a);
+          if (rc != 0)
+          {
+               fprintf(stderr, "ERROR: could not create producer thread %d\n", i);
+               goto abandon;
+          }
+          started_p++;
+     }
+
+     /*Create the consumer threads*/
+     for (int i = 0; i < numc; i++)
+     {
+          pthread_attr_t *a = pin_attr(&attr, cons_cpu, i);
+          int rc = pthread_create(&consumers[i], a, consumer, (void *)&cargs[i]);
+          if (a)
+               pthread_attr_destroy(a);
+          if (rc != 0)
+          {
+               fprintf(stderr, "ERROR: could not create consumer thread %d\n", i);
+               goto abandon;
+          }
+          started_c++;
+     }
+
+     /*Everybody is up: release them together and start the clock*/
+     gate_open(&sim.start, nump + numc, false);
+     uint64_t steady_start = timing_now_ns();
+
+     /*Wait for all the the producer threads to finish*/
+     for (int i = 0; i < nump; i++)
+     {
+          pthread_join(producers[i], NULL);
+     }
+
+     // Once all the producers are finished we set a flag so the consumer thread can finish up
+     // Once shutdown is called your queue should drain all remaining items and be read for
+     // destruction!
+     uint64_t drain_start = timing_now_ns();
+     queue_shutdown(sim.pc_queue);
+
+     /*Wait for all the the consumer threads to finish*/
+     for (int i = 0; i < numc; i++)
+     {
+          pthread_join(consumers[i], NULL);
+     }
+     uint64_t drain_end = timing_now_ns();
+
+     /*Add up the per-thread tallies*/
+     uint64_t produced_sum = 0, consumed_sum = 0;
+     res->produced = res->consumed = 0;
+     for (int i = 0; i < nump; i++)
+     {
+          res->produced += pargs[i].produced.num;
+          produced_sum += pargs[i].produced.checksum;
+     }
+     for (int i = 0; i < numc; i++)
+     {
+          res->consumed += cargs[i].consumed.num;
+          consumed_sum += cargs[i].consumed.checksum;
+     }
+     res->checksum_ok = produced_sum == consumed_sum;
+     res->empty_at_end = is_empty(sim.pc_queue);
+
+     // Free up all the stuff we allocated
+     pthread_cond_destroy(&sim.start.cond);
+     pthread_mutex_destroy(&sim.start.lock);
+     queue_destroy(sim.pc_queue);
+
+     // End our timing
+     res->setup_ms = ms_between(setup_start, steady_start);
+     res->steady_ms = ms_between(steady_start, drain_start);
+     res->drain_ms = ms_between(drain_start, drain_end);
+     res->elapsed_ms = res->steady_ms + res->drain_ms;
+
+     /*Merge the per-consumer histograms*/
+     hist_init(&res->latency);
+     for (int i = 0; i < numc; i++)
+     {
+          hist_merge(&res->latency, &cargs[i].latency);
+     }
+     free(producers);
+     free(consumers);
+     free(pargs);
+     free(cargs);
+     free(prod_cpu);
+     free(cons_cpu);
+     return 0;
+
+abandon:
+     /*send the threads already started home without running*/
+     gate_open(&sim.start, 0, true);
+     queue_shutdown(sim.pc_queue);
+     for (int i = 0; i < started_p; i++)
+          pthread_join(producers[i], NULL);
+     for (int i = 0; i < started_c; i++)
+          pthread_join(consumers[i], NULL);
+     pthread_cond_destroy(&sim.start.cond);
+     pthread_mutex_destroy(&sim.start.lock);
+     queue_destroy(sim.pc_queue);
+fail:
+     free(producers);
+     free(consumers);
+     free(pargs);
+     free(cargs);
+     free(prod_cpu);
+     free(cons_cpu);
+     return -1;
+}
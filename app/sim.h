@@ -0,0 +1,63 @@
+#ifndef SIM_H
+#define SIM_H
+#include <stdbool.h>
+#include "dist.h"
+#include "histogram.h"
+#include "topology.h"
+
+/*Inter-arrival time distribution for open-loop runs*/
+enum arrival
+{
+     ARRIVAL_CONSTANT = 0,
+     ARRIVAL_POISSON,
+};
+
+/**
+ * @brief One producer/consumer run over a shared queue.
+ */
+struct sim_config
+{
+     int producers;  /*number of producer threads*/
+     int consumers;  /*number of consumer threads*/
+     int items;      /*total items, split evenly across producers*/
+     int queue_size; /*capacity of the queue*/
+     int batch;      /*items moved per enqueue_batch/dequeue_batch call, 1 = single ops*/
+     struct dist produce;  /*simulated work before making each item*/
+     struct dist consume;  /*simulated work before taking each item*/
+     bool spin;            /*busy-spin the simulated work instead of sleeping*/
+     uint64_t seed;        /*base seed; producer k uses seed + 2k, consumer k seed + 2k + 1*/
+     const struct placement *placement; /*CPU pinning, NULL to let threads float*/
+     double rate;          /*open loop: target items/s over all producers, 0 = closed loop*/
+     enum arrival arrival; /*inter-arrival distribution when rate > 0*/
+};
+
+struct sim_result
+{
+     double elapsed_ms;    /*steady_ms + drain_ms: time the queue was in use*/
+     double setup_ms;      /*queue_init and thread creation*/
+     double steady_ms;     /*threads released until the last producer finished*/
+     double drain_ms;      /*queue_shutdown until the last consumer exited*/
+     unsigned int produced;
+     unsigned int consumed;
+     bool empty_at_end;    /*queue reported empty after the consumers exited*/
+     bool checksum_ok;     /*consumers saw exactly the item values produced*/
+     histogram_t latency;  /*enqueue-to-dequeue latency in nanoseconds*/
+};
+
+/**
+ * @brief Parse a producer or consumer count. "auto" gives half of the CPUs
+ * this process may run on (at least 1), so auto producers plus auto
+ * consumers fill the machine.
+ *
+ * @return the count, or -1 if @p arg is neither "auto" nor a positive number
+ */
+int sim_parse_threads(const char *arg);
+
+/**
+ * @brief Run one simulation with @p cfg and fill in @p res.
+ *
+ * @return 0 on success, -1 if the run could not be set up
+ */
+int sim_run(const struct sim_config *cfg, struct sim_result *res);
+
+#endif
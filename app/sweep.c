@@ -0,0 +1,428 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "sim.h"
+#include "sweep.h"
+#include "timing.h"
+
+#define MAX_LIST 32 /* Maximum number of values in one list */
+
+struct int_list
+{
+     int n;
+     int v[MAX_LIST];
+};
+
+struct sweep_config
+{
+     struct int_list producers;
+     struct int_list consumers;
+     struct int_list queue_sizes;
+     struct int_list batch_sizes;
+     struct int_list rates; /*0 = closed loop*/
+     enum arrival arrival;
+     int items;
+     int warmup;
+     int repetitions;
+     struct dist produce;
+     struct dist consume;
+     bool spin;
+     uint64_t seed;
+     struct placement placement;
+     bool json;
+     char output[256];
+};
+
+/*Summary of all repetitions of one point in the sweep*/
+struct point
+{
+     struct sim_config cfg;
+     double mean_ms;
+     double stddev_ms;
+     double throughput; /*items per second, from the mean*/
+     histogram_t latency;
+};
+
+struct host_info
+{
+     char cpu[128];
+     long cores;
+     char kernel[256];
+     const char *clock;
+};
+
+static char *trim(char *s)
+{
+     while (isspace((unsigned char)*s))
+          s++;
+     char *e = s + strlen(s);
+     while (e > s && isspace((unsigned char)e[-1]))
+          *--e = '\0';
+     return s;
+}
+
+/* 1 for true or 1, 0 for false or 0, -1 for anything else */
+static int parse_bool(const char *val)
+{
+     if (strcmp(val, "true") == 0 || strcmp(val, "1") == 0)
+          return 1;
+     if (strcmp(val, "false") == 0 || strcmp(val, "0") == 0)
+          return 0;
+     return -1;
+}
+
+/* a whole decimal number in [min, INT_MAX] into out; 0 on success, -1 otherwise */
+static int parse_int(const char *val, long min, int *out)
+{
+     char *end;
+     errno = 0;
+     long v = strtol(val, &end, 10);
+     if (end == val || *end != '\0' || errno == ERANGE || v < min || v > INT_MAX)
+          return -1;
+     *out = (int)v;
+     return 0;
+}
+
+/* a whole unsigned number (decimal, 0x hex or 0 octal) into out; 0 on success, -1 otherwise */
+static int parse_seed(const char *val, uint64_t *out)
+{
+     char *end;
+     errno = 0;
+     unsigned long long v = strtoull(val, &end, 0);
+     if (end == val || *end != '\0' || errno == ERANGE || *val == '-')
+          return -1;
+     *out = v;
+     return 0;
+}
+
+static int parse_list(const char *val, struct int_list *out, bool threads, long min)
+{
+     char buf[512];
+     snprintf(buf, sizeof(buf), "%s", val);
+     out->n = 0;
+     for (char *tok = strtok(buf, ","); tok; tok = strtok(NULL, ","))
+     {
+          if (out->n == MAX_LIST)
+               return -1;
+          if (threads)
+          {
+               int v = sim_parse_threads(trim(tok));
+               if (v < min)
+                    return -1;
+               out->v[out->n] = v;
+          }
+          else if (parse_int(trim(tok), min, &out->v[out->n]) != 0)
+               return -1;
+          out->n++;
+     }
+     return out->n > 0 ? 0 : -1;
+}
+
+static int parse_config(const char *path, struct sweep_config *sc)
+{
+     FILE *f = fopen(path, "r");
+     if (!f)
+     {
+          perror(path);
+          return -1;
+     }
+
+     *sc = (struct sweep_config){
+         .producers = {1, {1}},
+         .consumers = {1, {1}},
+         .queue_sizes = {1, {5}},
+         .batch_sizes = {1, {1}},
+         .rates = {1, {0}},
+         .items = 100000,
+         .warmup = 1,
+         .repetitions = 5,
+         .seed = 1,
+     };
+
+     char line[512];
+     int lineno = 0;
+     int rc = 0;
+     while (rc == 0 && fgets(line, sizeof(line), f))
+     {
+          lineno++;
+          char *hash = strchr(line, '#');
+          if (hash)
+               *hash = '\0';
+          char *key = trim(line);
+          if (*key == '\0')
+               continue;
+          char *eq = strchr(key, '=');
+          if (!eq)
+          {
+               rc = -1;
+               break;
+          }
+          *eq = '\0';
+          char *val = trim(eq + 1);
+          key = trim(key);
+
+          if (strcmp(key, "producers") == 0)
+               rc = parse_list(val, &sc->producers, true, 1);
+          else if (strcmp(key, "consumers") == 0)
+               rc = parse_list(val, &sc->consumers, true, 1);
+          else if (strcmp(key, "queue_sizes") == 0)
+               rc = parse_list(val, &sc->queue_sizes, false, 1);
+          else if (strcmp(key, "batch_sizes") == 0)
+               rc = parse_list(val, &sc->batch_sizes, false, 1);
+          else if (strcmp(key, "rates") == 0)
+               rc = parse_list(val, &sc->rates, false, 0);
+          else if (strcmp(key, "arrival") == 0)
+          {
+               sc->arrival = strcmp(val, "poisson") == 0 ? ARRIVAL_POISSON : ARRIVAL_CONSTANT;
+               rc = (sc->arrival == ARRIVAL_POISSON || strcmp(val, "constant") == 0) ? 0 : -1;
+          }
+          else if (strcmp(key, "items") == 0)
+               rc = parse_int(val, 1, &sc->items);
+          else if (strcmp(key, "warmup") == 0)
+               rc = parse_int(val, 0, &sc->warmup);
+          else if (strcmp(key, "repetitions") == 0)
+               rc = parse_int(val, 1, &sc->repetitions);
+          else if (strcmp(key, "delay") == 0)
+          {
+               int on = parse_bool(val);
+               if (on == 1)
+               {
+                    dist_parse("uniform:1000", &sc->produce);
+                    dist_parse("uniform:1000", &sc->consume);
+               }
+               rc = on < 0 ? -1 : 0;
+          }
+          else if (strcmp(key, "produce") == 0)
+               rc = dist_parse(val, &sc->produce);
+          else if (strcmp(key, "consume") == 0)
+               rc = dist_parse(val, &sc->consume);
+          else if (strcmp(key, "spin") == 0)
+          {
+               int on = parse_bool(val);
+               sc->spin = on == 1;
+               rc = on < 0 ? -1 : 0;
+          }
+          else if (strcmp(key, "seed") == 0)
+               rc = parse_seed(val, &sc->seed);
+          else if (strcmp(key, "placement") == 0)
+               rc = placement_parse(val, &sc->placement);
+          else if (strcmp(key, "format") == 0)
+          {
+               sc->json = strcmp(val, "json") == 0;
+               rc = (sc->json || strcmp(val, "csv") == 0) ? 0 : -1;
+          }
+          else if (strcmp(key, "output") == 0)
+               snprintf(sc->output, sizeof(sc->output), "%s", val);
+          else
+               rc = -1;
+     }
+     fclose(f);
+
+     if (rc != 0)
+          fprintf(stderr, "%s:%d: bad sweep setting\n", path, lineno);
+     return rc;
+}
+
+static void host_info(struct host_info *h)
+{
+     snprintf(h->cpu, sizeof(h->cpu), "unknown");
+     FILE *f = fopen("/proc/cpuinfo", "r");
+     if (f)
+     {
+          char line[256];
+          while (fgets(line, sizeof(line), f))
+          {
+               if (strncmp(line, "model name", 10) == 0)
+               {
+                    char *colon = strchr(line, ':');
+                    if (colon)
+                         snprintf(h->cpu, sizeof(h->cpu), "%s", trim(colon + 1));
+                    break;
+               }
+          }
+          fclose(f);
+     }
+     h->cores = sysconf(_SC_NPROCESSORS_ONLN);
+     timing_init();
+     h->clock = timing_source();
+
+     struct utsname u;
+     if (uname(&u) == 0)
+          snprintf(h->kernel, sizeof(h->kernel), "%s %s", u.sysname, u.release);
+     else
+          snprintf(h->kernel, sizeof(h->kernel), "unknown");
+}
+
+/* Run warmups and repetitions for one point. res is scratch space. */
+static int run_point(const struct sweep_config *sc, struct point *pt, struct sim_result *res)
+{
+     double sum = 0, sumsq = 0;
+
+     for (int i = 0; i < sc->warmup; i++)
+     {
+          if (sim_run(&pt->cfg, res) != 0)
+               return -1;
+     }
+
+     hist_init(&pt->latency);
+     for (int i = 0; i < sc->repetitions; i++)
+     {
+          if (sim_run(&pt->cfg, res) != 0)
+               return -1;
+          if (res->produced != res->consumed || !res->checksum_ok)
+          {
+               fprintf(stderr, "ERROR! produced != consumed\n");
+               return -1;
+          }
+          sum += res->elapsed_ms;
+          sumsq += res->elapsed_ms * res->elapsed_ms;
+          hist_merge(&pt->latency, &res->latency);
+     }
+
+     int n = sc->repetitions;
+     double var = n > 1 ? (sumsq - sum * sum / n) / (n - 1) : 0.0;
+     pt->mean_ms = sum / n;
+     pt->stddev_ms = var > 0 ? sqrt(var) : 0.0; /* rounding can push var just below 0 */
+     pt->throughput = pt->mean_ms > 0 ? res->produced / (pt->mean_ms / 1000.0) : 0.0;
+     return 0;
+}
+
+static void json_string(FILE *out, const char *s)
+{
+     fputc('"', out);
+     for (; *s; s++)
+     {
+          if (*s == '"' || *s == '\\')
+               fputc('\\', out);
+          if ((unsigned char)*s >= 0x20)
+               fputc(*s, out);
+     }
+     fputc('"', out);
+}
+
+static void write_header(FILE *out, const struct sweep_config *sc, const struct host_info *h)
+{
+     if (sc->json)
+     {
+          fprintf(out, "{\n  \"host\": {\"cpu\": ");
+          json_string(out, h->cpu);
+          fprintf(out, ", \"cores\": %ld, \"kernel\": ", h->cores);
+          json_string(out, h->kernel);
+          fprintf(out, ", \"clock\": \"%s\"},\n", h->clock);
+          fprintf(out, "  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+                  sc->warmup, sc->repetitions);
+          return;
+     }
+     fprintf(out, "# cpu: %s\n# cores: %ld\n# kernel: %s\n# clock: %s\n# warmup: %d repetitions: %d\n",
+             h->cpu, h->cores, h->kernel, h->clock, sc->warmup, sc->repetitions);
+     fprintf(out, "producers,consumers,queue_size,batch,rate,items,mean_ms,stddev_ms,"
+                  "throughput,p50_us,p90_us,p99_us,p999_us,max_us\n");
+}
+
+static void write_point(FILE *out, const struct sweep_config *sc, const struct point *pt, bool first)
+{
+     const struct sim_config *c = &pt->cfg;
+     double p50 = hist_percentile(&pt->latency, 50.0) / 1000.0;
+     double p90 = hist_percentile(&pt->latency, 90.0) / 1000.0;
+     double p99 = hist_percentile(&pt->latency, 99.0) / 1000.0;
+     double p999 = hist_percentile(&pt->latency, 99.9) / 1000.0;
+     double max = pt->latency.max / 1000.0;
+
+     if (sc->json)
+     {
+          fprintf(out, "%s\n    {\"producers\": %d, \"consumers\": %d, \"queue_size\": %d, "
+                       "\"batch\": %d, \"rate\": %.0f, \"items\": %d, \"mean_ms\": %.3f, \"stddev_ms\": %.3f, "
+                       "\"throughput\": %.1f, \"p50_us\": %.3f, \"p90_us\": %.3f, "
+                       "\"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f}",
+                  first ? "" : ",", c->producers, c->consumers, c->queue_size, c->batch,
+                  c->rate, c->items, pt->mean_ms, pt->stddev_ms, pt->throughput, p50, p90, p99, p999, max);
+          return;
+     }
+     fprintf(out, "%d,%d,%d,%d,%.0f,%d,%.3f,%.3f,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+             c->producers, c->consumers, c->queue_size, c->batch, c->rate, c->items,
+             pt->mean_ms, pt->stddev_ms, pt->throughput, p50, p90, p99, p999, max);
+}
+
+int sweep_run(const char *path)
+{
+     struct sweep_config sc;
+     struct host_info host;
+
+     if (parse_config(path, &sc) != 0)
+          return -1;
+     host_info(&host);
+
+     FILE *out = stdout;
+     if (sc.output[0] != '\0')
+     {
+          out = fopen(sc.output, "w");
+          if (!out)
+          {
+               perror(sc.output);
+               return -1;
+          }
+     }
+
+     struct point *pt = (struct point *)malloc(sizeof(struct point));
+     struct sim_result *res = (struct sim_result *)malloc(sizeof(struct sim_result));
+     int rc = (pt && res) ? 0 : -1;
+     bool first = true;
+
+     if (rc == 0)
+          write_header(out, &sc, &host);
+     /*Every combination of the lists, last list varying fastest*/
+     int npoints = sc.producers.n * sc.consumers.n * sc.queue_sizes.n * sc.batch_sizes.n * sc.rates.n;
+     for (int i = 0; rc == 0 && i < npoints; i++)
+     {
+          int k = i;
+          int r = k % sc.rates.n;
+          k /= sc.rates.n;
+          int b = k % sc.batch_sizes.n;
+          k /= sc.batch_sizes.n;
+          int q = k % sc.queue_sizes.n;
+          k /= sc.queue_sizes.n;
+          int c = k % sc.consumers.n;
+          int p = k / sc.consumers.n;
+
+          pt->cfg = (struct sim_config){
+              .producers = sc.producers.v[p],
+              .consumers = sc.consumers.v[c],
+              .items = sc.items,
+              .queue_size = sc.queue_sizes.v[q],
+              .batch = sc.batch_sizes.v[b],
+              .produce = sc.produce,
+              .consume = sc.consume,
+              .spin = sc.spin,
+              .seed = sc.seed,
+              .placement = &sc.placement,
+              .rate = sc.rates.v[r],
+              .arrival = sc.arrival,
+          };
+          fprintf(stderr, "sweep: %d producers %d consumers queue %d batch %d rate %.0f\n",
+                  pt->cfg.producers, pt->cfg.consumers, pt->cfg.queue_size, pt->cfg.batch,
+                  pt->cfg.rate);
+          rc = run_point(&sc, pt, res);
+          if (rc == 0)
+          {
+               write_point(out, &sc, pt, first);
+               fflush(out);
+               first = false;
+          }
+     }
+     if (sc.json && !first)
+          fprintf(out, "\n  ]\n}\n");
+     else if (sc.json)
+          fprintf(out, "]\n}\n");
+
+     if (out != stdout)
+          fclose(out);
+     free(pt);
+     free(res);
+     return rc;
+}
@@ -0,0 +1,35 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/*
+ * Parameter sweep over sim_run(). The config file holds one "key = value"
+ * per line; '#' starts a comment. List values are comma separated and
+ * every combination of the lists is run.
+ *
+ *   producers    = 1,2,4,auto  list, auto as for -p
+ *   consumers    = 1,2,4,auto  list, auto as for -c
+ *   queue_sizes  = 5,64,1024   list
+ *   batch_sizes  = 1,16        list
+ *   rates        = 0,50000     list of open-loop items/s, 0 = closed loop
+ *   arrival      = poisson     constant or poisson, for rates > 0
+ *   items        = 100000      total items per run
+ *   warmup       = 1           untimed runs before each point
+ *   repetitions  = 5           timed runs per point
+ *   delay        = false       same as -d
+ *   produce      = exp:5       producer service time, same as -P
+ *   consume      = const:2     consumer service time, same as -C
+ *   spin         = false       same as -w
+ *   seed         = 1           same as -S
+ *   placement    = compact     same as -a, none when omitted
+ *   format       = csv         csv or json
+ *   output       = sweep.csv   file to write, stdout when omitted
+ */
+
+/**
+ * @brief Load the sweep described in @p path, run it and write the results.
+ *
+ * @return 0 on success, -1 on a bad config or a failed run
+ */
+int sweep_run(const char *path);
+
+#endif
@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define TSC_SHIFT 24 /* fixed point fraction bits of the ticks->ns factor */
+
+static bool use_tsc = false;
+static uint64_t tsc_base;  /*TSC at calibration*/
+static uint64_t ns_base;   /*CLOCK_MONOTONIC_RAW at calibration*/
+static uint64_t tsc_mult;  /*ns per tick << TSC_SHIFT*/
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static uint64_t raw_now_ns(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+     return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef HAVE_TSC
+static bool invariant_tsc(void)
+{
+     FILE *f = fopen("/proc/cpuinfo", "r");
+     char line[4096];
+     bool constant = false, nonstop = false;
+     if (!f)
+          return false;
+     while (fgets(line, sizeof(line), f))
+     {
+          if (strncmp(line, "flags", 5) == 0)
+          {
+               constant = strstr(line, " constant_tsc") != NULL;
+               nonstop = strstr(line, " nonstop_tsc") != NULL;
+               break;
+          }
+     }
+     fclose(f);
+     return constant && nonstop;
+}
+#endif
+
+static void calibrate(void)
+{
+#ifdef HAVE_TSC
+     if (!invariant_tsc())
+          return;
+
+     struct timespec pause = {0, 20000000};
+     uint64_t t0 = raw_now_ns();
+     uint64_t c0 = __rdtsc();
+     nanosleep(&pause, NULL);
+     uint64_t t1 = raw_now_ns();
+     uint64_t c1 = __rdtsc();
+     if (c1 <= c0 || t1 <= t0)
+          return;
+
+     tsc_mult = (uint64_t)(((double)(t1 - t0) / (double)(c1 - c0)) * (double)(1ull << TSC_SHIFT));
+     tsc_base = c1;
+     ns_base = t1;
+     use_tsc = tsc_mult > 0;
+#endif
+}
+
+void timing_init(void)
+{
+     pthread_once(&once, calibrate);
+}
+
+uint64_t timing_now_ns(void)
+{
+#ifdef HAVE_TSC
+     if (use_tsc)
+     {
+          uint64_t d = __rdtsc() - tsc_base;
+          return ns_base + (uint64_t)(((unsigned __int128)d * tsc_mult) >> TSC_SHIFT);
+     }
+#endif
+     return raw_now_ns();
+}
+
+const char *timing_source(void)
+{
+     return use_tsc ? "tsc" : "monotonic_raw";
+}
@@ -0,0 +1,24 @@
+#ifndef TIMING_H
+#define TIMING_H
+#include <stdint.h>
+
+/**
+ * @brief Pick the clock used by timing_now_ns(). On x86 with an invariant
+ * TSC (constant_tsc and nonstop_tsc in /proc/cpuinfo) the TSC is calibrated
+ * against CLOCK_MONOTONIC_RAW, which takes about 20ms once; otherwise
+ * CLOCK_MONOTONIC_RAW is read directly. Safe to call more than once.
+ */
+void timing_init(void);
+
+/**
+ * @brief Monotonic timestamp in nanoseconds. Only differences between two
+ * calls are meaningful. Uses CLOCK_MONOTONIC_RAW until timing_init() runs.
+ */
+uint64_t timing_now_ns(void);
+
+/**
+ * @brief Name of the clock in use, "tsc" or "monotonic_raw".
+ */
+const char *timing_source(void);
+
+#endif
@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "topology.h"
+
+#define SYS_CPU "/sys/devices/system/cpu"
+
+struct cpu
+{
+     int id;
+     int package; /*physical socket*/
+     int core;    /*lowest CPU number among the SMT siblings*/
+     int l3;      /*lowest CPU number sharing the last level cache*/
+     int rank;    /*position among the SMT siblings of the core*/
+     int slot;    /*position of the core inside its socket*/
+};
+
+/* parse "0,2,4-7" into out; returns the number of entries or -1 */
+static int parse_cpu_list(const char *s, int *out, int max)
+{
+     int n = 0;
+     while (*s && *s != '\n')
+     {
+          char *end;
+          long lo = strtol(s, &end, 10);
+          if (end == s || lo < 0 || lo > INT_MAX)
+               return -1;
+          long hi = lo;
+          s = end;
+          if (*s == '-')
+          {
+               hi = strtol(s + 1, &end, 10);
+               if (end == s + 1 || hi < lo || hi > INT_MAX)
+                    return -1;
+               s = end;
+          }
+          for (long c = lo; c <= hi; c++)
+          {
+               if (n == max)
+                    return -1;
+               out[n++] = (int)c;
+          }
+          if (*s == ',')
+               s++;
+          else if (*s && *s != '\n')
+               return -1;
+     }
+     return n;
+}
+
+/* first number of a sysfs file (a plain integer or a CPU list), or -1 */
+static int read_first_int(const char *path)
+{
+     FILE *f = fopen(path, "r");
+     int v = -1;
+     if (f)
+     {
+          if (fscanf(f, "%d", &v) != 1)
+               v = -1;
+          fclose(f);
+     }
+     return v;
+}
+
+static int l3_of(int cpu)
+{
+     char path[128];
+     for (int idx = 0;; idx++)
+     {
+          snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, idx);
+          int level = read_first_int(path);
+          if (level < 0)
+               return -1;
+          if (level == 3)
+          {
+               snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+               return read_first_int(path);
+          }
+     }
+}
+
+/* the CPUs we may run on, with topology; returns the count or -1 */
+static int load_cpus(struct cpu **out)
+{
+     cpu_set_t set;
+     if (sched_getaffinity(0, sizeof(set), &set) != 0)
+          return -1;
+
+     struct cpu *cpus = (struct cpu *)calloc(CPU_COUNT(&set), sizeof(struct cpu));
+     if (!cpus)
+          return -1;
+
+     int n = 0;
+     char path[128];
+     for (int c = 0; c < CPU_SETSIZE; c++)
+     {
+          if (!CPU_ISSET(c, &set))
+               continue;
+          struct cpu *p = &cpus[n++];
+          p->id = c;
+          snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id", c);
+          p->package = read_first_int(path);
+          snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list", c);
+          p->core = read_first_int(path);
+          if (p->core < 0)
+               p->core = c;
+          p->l3 = l3_of(c);
+          if (p->l3 < 0)
+               p->l3 = p->package;
+     }
+     for (int i = 0; i < n; i++)
+          for (int j = 0; j < n; j++)
+          {
+               if (j < i && cpus[j].core == cpus[i].core)
+                    cpus[i].rank++;
+               /* count each other core of the socket once, via its first thread */
+               if (cpus[j].package == cpus[i].package && cpus[j].core < cpus[i].core && cpus[j].id == cpus[j].core)
+                    cpus[i].slot++;
+          }
+
+     *out = cpus;
+     return n;
+}
+
+static int cmp_compact(const void *a, const void *b)
+{
+     const struct cpu *x = a, *y = b;
+     if (x->package != y->package)
+          return x->package - y->package;
+     if (x->l3 != y->l3)
+          return x->l3 - y->l3;
+     if (x->core != y->core)
+          return x->core - y->core;
+     return x->id - y->id;
+}
+
+static int cmp_scatter(const void *a, const void *b)
+{
+     const struct cpu *x = a, *y = b;
+     if (x->rank != y->rank)
+          return x->rank - y->rank;
+     if (x->slot != y->slot)
+          return x->slot - y->slot;
+     if (x->package != y->package)
+          return x->package - y->package;
+     return x->id - y->id;
+}
+
+/*
+ * Build producer/consumer CPU pairs for the pairing modes into a and b.
+ * cpus must be in compact order. Returns the number of pairs.
+ */
+static int make_pairs(enum placement_mode mode, const struct cpu *cpus, int n, int *a, int *b)
+{
+     int np = 0;
+     switch (mode)
+     {
+     case PLACE_SMT:
+          for (int i = 0; i < n; i++)
+               for (int j = i + 1; cpus[i].rank == 0 && j < n; j++)
+                    if (cpus[j].core == cpus[i].core)
+                    {
+                         a[np] = cpus[i].id;
+                         b[np++] = cpus[j].id;
+                         break;
+                    }
+          break;
+     case PLACE_L3:
+          /* first thread of each core, paired with the next core on the same L3 */
+          for (int i = 0; i < n; i++)
+          {
+               if (cpus[i].rank != 0)
+                    continue;
+               for (int j = i + 1; j < n; j++)
+               {
+                    if (cpus[j].rank != 0)
+                         continue;
+                    if (cpus[j].l3 == cpus[i].l3)
+                    {
+                         a[np] = cpus[i].id;
+                         b[np++] = cpus[j].id;
+                         i = j;
+                    }
+                    break;
+               }
+          }
+          break;
+     case PLACE_CROSS:
+     {
+          /* k-th CPU of the first socket with the k-th CPU of the next one */
+          int second = -1;
+          for (int i = 0; i < n && second < 0; i++)
+               if (cpus[i].package != cpus[0].package)
+                    second = i;
+          for (int i = 0; second >= 0 && i < second && second + i < n; i++)
+          {
+               if (cpus[second + i].package != cpus[second].package)
+                    break;
+               a[np] = cpus[i].id;
+               b[np++] = cpus[second + i].id;
+          }
+          break;
+     }
+     default:
+          break;
+     }
+     return np;
+}
+
+int placement_parse(const char *spec, struct placement *out)
+{
+     memset(out, 0, sizeof(*out));
+     if (strcmp(spec, "none") == 0)
+          out->mode = PLACE_NONE;
+     else if (strcmp(spec, "compact") == 0)
+          out->mode = PLACE_COMPACT;
+     else if (strcmp(spec, "scatter") == 0)
+          out->mode = PLACE_SCATTER;
+     else if (strcmp(spec, "smt") == 0)
+          out->mode = PLACE_SMT;
+     else if (strcmp(spec, "l3") == 0)
+          out->mode = PLACE_L3;
+     else if (strcmp(spec, "cross") == 0)
+          out->mode = PLACE_CROSS;
+     else
+     {
+          if (strncmp(spec, "list:", 5) == 0)
+               spec += 5;
+          out->mode = PLACE_LIST;
+          out->ncpus = parse_cpu_list(spec, out->cpus, PLACE_MAX_LIST);
+          if (out->ncpus <= 0)
+               return -1;
+     }
+     return 0;
+}
+
+static int plan(const struct placement *pl, int nprod, int ncons, int *prod_cpu, int *cons_cpu)
+{
+     if (pl->mode == PLACE_LIST)
+     {
+          for (int i = 0; i < nprod; i++)
+               prod_cpu[i] = pl->cpus[i % pl->ncpus];
+          for (int i = 0; i < ncons; i++)
+               cons_cpu[i] = pl->cpus[(nprod + i) % pl->ncpus];
+          return 0;
+     }
+
+     struct cpu *cpus = NULL;
+     int n = load_cpus(&cpus);
+     if (n <= 0)
+          return -1;
+
+     int rc = 0;
+     qsort(cpus, n, sizeof(struct cpu), cmp_compact);
+     if (pl->mode == PLACE_COMPACT || pl->mode == PLACE_SCATTER)
+     {
+          if (pl->mode == PLACE_SCATTER)
+               qsort(cpus, n, sizeof(struct cpu), cmp_scatter);
+          for (int i = 0; i < nprod; i++)
+               prod_cpu[i] = cpus[i % n].id;
+          for (int i = 0; i < ncons; i++)
+               cons_cpu[i] = cpus[(nprod + i) % n].id;
+     }
+     else
+     {
+          int *a = (int *)malloc(sizeof(int) * n);
+          int *b = (int *)malloc(sizeof(int) * n);
+          int np = (a && b) ? make_pairs(pl->mode, cpus, n, a, b) : 0;
+          if (np == 0)
+               rc = -1;
+          for (int i = 0; rc == 0 && i < nprod; i++)
+               prod_cpu[i] = a[i % np];
+          for (int i = 0; rc == 0 && i < ncons; i++)
+               cons_cpu[i] = b[i % np];
+          free(a);
+          free(b);
+     }
+     free(cpus);
+     return rc;
+}
+
+/* true if every CPU in cpus is one this process may run on */
+static bool all_allowed(const cpu_set_t *allowed, const int *cpus, int n)
+{
+     for (int i = 0; i < n; i++)
+          if (cpus[i] >= CPU_SETSIZE || !CPU_ISSET(cpus[i], allowed))
+               return false;
+     return true;
+}
+
+int placement_plan(const struct placement *pl, int nprod, int ncons, int *prod_cpu, int *cons_cpu)
+{
+     if (plan(pl, nprod, ncons, prod_cpu, cons_cpu) != 0)
+          return -1;
+     /* offline CPUs and CPUs outside our cpuset are missing from the mask, and
+        pinning a thread to one of them would make pthread_create fail */
+     cpu_set_t allowed;
+     if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+          return -1;
+     if (!all_allowed(&allowed, prod_cpu, nprod) || !all_allowed(&allowed, cons_cpu, ncons))
+          return -1;
+     return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/*
+ * Thread placement for the benchmark. CPU topology comes from
+ * /sys/devices/system/cpu and only CPUs in the process affinity mask are
+ * used.
+ *
+ *   compact   fill one core, L3 and socket before moving to the next
+ *   scatter   spread threads over sockets first, then cores, then SMT siblings
+ *   list      explicit CPU list, e.g. "0,2,4-7"; threads cycle through it
+ *   smt       producer i and consumer i on two SMT siblings of one core
+ *   l3        producer i and consumer i on different cores sharing an L3
+ *   cross     producer i and consumer i on different sockets
+ *
+ * For compact, scatter and list producers take the first CPUs of the order
+ * and consumers the ones after them.
+ */
+enum placement_mode
+{
+     PLACE_NONE = 0,
+     PLACE_COMPACT,
+     PLACE_SCATTER,
+     PLACE_LIST,
+     PLACE_SMT,
+     PLACE_L3,
+     PLACE_CROSS,
+};
+
+#define PLACE_MAX_LIST 1024 /* Maximum number of CPUs in an explicit list */
+
+struct placement
+{
+     enum placement_mode mode;
+     int ncpus;                /*entries in cpus, PLACE_LIST only*/
+     int cpus[PLACE_MAX_LIST];
+};
+
+/**
+ * @brief Parse a placement spec: none, compact, scatter, smt, l3, cross or
+ * a CPU list (optionally written as list:0,2,4-7).
+ *
+ * @return 0 on success, -1 if @p spec is not understood
+ */
+int placement_parse(const char *spec, struct placement *out);
+
+/**
+ * @brief Pick a CPU for every producer and consumer thread.
+ *
+ * @param pl the placement to apply
+ * @param nprod number of producers
+ * @param ncons number of consumers
+ * @param prod_cpu receives nprod CPU numbers
+ * @param cons_cpu receives ncons CPU numbers
+ * @return 0 on success, -1 if the machine cannot satisfy the placement
+ * (e.g. smt without SMT siblings, cross on a single socket, or a CPU list
+ * naming CPUs that are offline or outside our affinity mask)
+ */
+int placement_plan(const struct placement *pl, int nprod, int ncons, int *prod_cpu, int *cons_cpu);
+
+#endif
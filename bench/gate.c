@@ -0,0 +1,179 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gate.h"
+
+#define Z_99 2.5758293035489 /* two-sided 99% normal quantile */
+
+void gate_add(struct metric_set *set, const char *name, const char *unit, bool higher_is_better,
+              int n, double mean, double stddev)
+{
+     if (set->n == GATE_MAX_METRICS)
+          return;
+     struct metric *m = &set->m[set->n++];
+     snprintf(m->name, sizeof(m->name), "%s", name);
+     snprintf(m->unit, sizeof(m->unit), "%s", unit);
+     m->higher_is_better = higher_is_better;
+     m->n = n;
+     m->mean = mean;
+     m->stddev = stddev;
+}
+
+void gate_host(char *out, int len)
+{
+     snprintf(out, len, "unknown");
+     FILE *f = fopen("/proc/cpuinfo", "r");
+     if (!f)
+          return;
+     char line[256];
+     while (fgets(line, sizeof(line), f))
+     {
+          char *colon = strchr(line, ':');
+          if (strncmp(line, "model name", 10) == 0 && colon)
+          {
+               colon += 2;
+               colon[strcspn(colon, "\n")] = '\0';
+               snprintf(out, len, "%s", colon);
+               break;
+          }
+     }
+     fclose(f);
+}
+
+int gate_save(const struct metric_set *set, const char *path)
+{
+     FILE *f = fopen(path, "w");
+     if (!f)
+     {
+          perror(path);
+          return -1;
+     }
+     fprintf(f, "# host: %s\n", set->host);
+     fprintf(f, "name,unit,better,n,mean,stddev\n");
+     for (int i = 0; i < set->n; i++)
+     {
+          const struct metric *m = &set->m[i];
+          fprintf(f, "%s,%s,%s,%d,%.6g,%.6g\n", m->name, m->unit,
+                  m->higher_is_better ? "higher" : "lower", m->n, m->mean, m->stddev);
+     }
+     return fclose(f) == 0 ? 0 : -1;
+}
+
+int gate_load(struct metric_set *set, const char *path)
+{
+     FILE *f = fopen(path, "r");
+     if (!f)
+     {
+          perror(path);
+          return -1;
+     }
+
+     char line[512];
+     int rc = 0;
+     memset(set, 0, sizeof(*set));
+     while (rc == 0 && fgets(line, sizeof(line), f))
+     {
+          line[strcspn(line, "\n")] = '\0';
+          if (strncmp(line, "# host: ", 8) == 0)
+          {
+               snprintf(set->host, sizeof(set->host), "%.127s", line + 8);
+               continue;
+          }
+          if (line[0] == '#' || line[0] == '\0' || strncmp(line, "name,", 5) == 0)
+               continue;
+
+          char name[GATE_NAME_LEN], unit[16], better[8];
+          int n;
+          double mean, stddev;
+          if (sscanf(line, "%63[^,],%15[^,],%7[^,],%d,%lf,%lf", name, unit, better, &n, &mean, &stddev) != 6)
+          {
+               fprintf(stderr, "%s: bad line: %s\n", path, line);
+               rc = -1;
+               break;
+          }
+          gate_add(set, name, unit, strcmp(better, "higher") == 0, n, mean, stddev);
+     }
+     fclose(f);
+     return rc;
+}
+
+/* two-sided 99% critical value of Student's t (Cornish-Fisher expansion) */
+static double t_critical(double df)
+{
+     double z = Z_99, z3 = z * z * z, z5 = z3 * z * z;
+     return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df);
+}
+
+/* Welch's t statistic and degrees of freedom for cur vs base */
+static double welch(const struct metric *base, const struct metric *cur, double *df)
+{
+     double vb = base->stddev * base->stddev / base->n;
+     double vc = cur->stddev * cur->stddev / cur->n;
+     double se2 = vb + vc;
+     if (se2 <= 0)
+     {
+          *df = 1e9;
+          return cur->mean == base->mean ? 0.0 : INFINITY;
+     }
+     double denom = 0;
+     if (base->n > 1)
+          denom += vb * vb / (base->n - 1);
+     if (cur->n > 1)
+          denom += vc * vc / (cur->n - 1);
+     *df = denom > 0 ? se2 * se2 / denom : 1e9;
+     return (cur->mean - base->mean) / sqrt(se2);
+}
+
+static const struct metric *find(const struct metric_set *set, const char *name)
+{
+     for (int i = 0; i < set->n; i++)
+          if (strcmp(set->m[i].name, name) == 0)
+               return &set->m[i];
+     return NULL;
+}
+
+int gate_compare(const struct metric_set *base, const struct metric_set *cur, double threshold_pct)
+{
+     int regressions = 0;
+
+     if (strcmp(base->host, cur->host) != 0)
+          printf("warning: baseline was taken on \"%s\", this is \"%s\"\n", base->host, cur->host);
+     printf("%-32s %12s %12s %9s %8s  %s\n", "metric", "baseline", "current", "change", "t", "verdict");
+
+     for (int i = 0; i < cur->n; i++)
+     {
+          const struct metric *c = &cur->m[i];
+          const struct metric *b = find(base, c->name);
+          if (!b)
+          {
+               printf("%-32s %12s %12.4g %9s %8s  new\n", c->name, "-", c->mean, "-", "-");
+               continue;
+          }
+
+          double df;
+          double t = welch(b, c, &df);
+          double change = b->mean != 0 ? 100.0 * (c->mean - b->mean) / b->mean : 0.0;
+          /* positive when the metric got worse */
+          double worse = c->higher_is_better ? -change : change;
+          bool significant = fabs(t) > t_critical(df < 1 ? 1 : df);
+
+          const char *verdict = "ok";
+          if (significant && worse > threshold_pct)
+          {
+               verdict = "REGRESSION";
+               regressions++;
+          }
+          else if (significant && worse < -threshold_pct)
+               verdict = "improved";
+
+          printf("%-32s %12.4g %12.4g %+8.1f%% %8.2f  %s (%s, %s is better)\n", c->name, b->mean, c->mean,
+                 change, t, verdict, c->unit, c->higher_is_better ? "higher" : "lower");
+     }
+     for (int i = 0; i < base->n; i++)
+          if (!find(cur, base->m[i].name))
+               printf("%-32s %12.4g %12s %9s %8s  not run\n", base->m[i].name, base->m[i].mean, "-", "-", "-");
+
+     printf("%d regression%s beyond %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold_pct);
+     return regressions;
+}
@@ -0,0 +1,66 @@
+#ifndef GATE_H
+#define GATE_H
+#include <stdbool.h>
+
+/*
+ * Regression gate. Every benchmark is reduced to a metric (mean, stddev
+ * and sample count); a baseline file holds one metric per line. A metric
+ * regresses when it moved in the bad direction by more than the threshold
+ * AND Welch's t-test says the move is significant at the 99% level, so
+ * noise alone does not fail the gate.
+ */
+
+#define GATE_NAME_LEN 64
+#define GATE_MAX_METRICS 128
+
+struct metric
+{
+     char name[GATE_NAME_LEN];
+     char unit[16];
+     bool higher_is_better;
+     int n;
+     double mean;
+     double stddev;
+};
+
+struct metric_set
+{
+     int n;
+     char host[128]; /*CPU model the metrics were taken on*/
+     struct metric m[GATE_MAX_METRICS];
+};
+
+/**
+ * @brief Append a metric to @p set; ignored when the set is full.
+ */
+void gate_add(struct metric_set *set, const char *name, const char *unit, bool higher_is_better,
+              int n, double mean, double stddev);
+
+/**
+ * @brief Write @p set to @p path as CSV.
+ *
+ * @return 0 on success, -1 on I/O errors
+ */
+int gate_save(const struct metric_set *set, const char *path);
+
+/**
+ * @brief Read a file written by gate_save().
+ *
+ * @return 0 on success, -1 if the file is missing or malformed
+ */
+int gate_load(struct metric_set *set, const char *path);
+
+/**
+ * @brief Print a comparison of @p cur against @p base on stdout.
+ *
+ * @param threshold_pct smallest slowdown, in percent, that may count as a regression
+ * @return the number of regressed metrics
+ */
+int gate_compare(const struct metric_set *base, const struct metric_set *cur, double threshold_pct);
+
+/**
+ * @brief Model name of this machine's CPU, from /proc/cpuinfo.
+ */
+void gate_host(char *out, int len);
+
+#endif
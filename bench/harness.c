@@ -0,0 +1,97 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "harness.h"
+
+#define MIN_ITERS 16
+#define MAX_ITERS (1ull << 26)
+
+uint64_t bench_now_ns(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+     return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+     double x = *(const double *)a, y = *(const double *)b;
+     return (x > y) - (x < y);
+}
+
+/* linear interpolation between closest ranks; v must be sorted */
+static double quantile(const double *v, int n, double q)
+{
+     double pos = q * (n - 1);
+     int lo = (int)pos;
+     int hi = lo + 1 < n ? lo + 1 : lo;
+     return v[lo] + (v[hi] - v[lo]) * (pos - lo);
+}
+
+/* grow the operation count until one run takes at least target_ns */
+static uint64_t calibrate(bench_fn fn, void *ctx, uint64_t target_ns)
+{
+     uint64_t iters = MIN_ITERS;
+     for (;;)
+     {
+          uint64_t ns = fn(ctx, iters);
+          if (ns >= target_ns || iters >= MAX_ITERS)
+               break;
+          /* aim a little past the target, at most 10x per step */
+          uint64_t next = ns > 0 ? (uint64_t)(iters * 1.2 * target_ns / ns) : iters * 10;
+          iters = next > iters * 10 ? iters * 10 : next > iters ? next : iters + 1;
+     }
+     return iters > MAX_ITERS ? MAX_ITERS : iters;
+}
+
+void bench_run(const char *name, bench_fn fn, void *ctx, const struct bench_opts *opts,
+               struct bench_result *out)
+{
+     int n = opts->samples > 0 ? opts->samples : 1;
+     double *v = (double *)malloc(sizeof(double) * n);
+     uint64_t iters = calibrate(fn, ctx, (uint64_t)(opts->sample_ms * 1e6));
+
+     fn(ctx, iters); /* warm up caches and the allocator at the final size */
+     for (int i = 0; i < n; i++)
+          v[i] = (double)fn(ctx, iters) / (double)iters;
+     qsort(v, n, sizeof(double), cmp_double);
+
+     double q1 = quantile(v, n, 0.25), q3 = quantile(v, n, 0.75);
+     double lo = q1 - 1.5 * (q3 - q1), hi = q3 + 1.5 * (q3 - q1);
+     int first = 0, last = n;
+     while (first < n && v[first] < lo)
+          first++;
+     while (last > first && v[last - 1] > hi)
+          last--;
+
+     double sum = 0, sumsq = 0;
+     for (int i = first; i < last; i++)
+     {
+          sum += v[i];
+          sumsq += v[i] * v[i];
+     }
+     int kept = last - first;
+     double var = kept > 1 ? (sumsq - sum * sum / kept) / (kept - 1) : 0.0;
+
+     out->name = name;
+     out->median_ns = quantile(v + first, kept, 0.5);
+     out->mean_ns = sum / kept;
+     out->stddev_ns = var > 0 ? sqrt(var) : 0.0;
+     out->min_ns = v[first];
+     out->kept = kept;
+     out->total = n;
+     free(v);
+}
+
+void bench_print_header(void)
+{
+     printf("%-28s %10s %10s %10s %10s %8s\n", "benchmark", "median_ns", "mean_ns", "stddev_ns", "min_ns", "kept");
+}
+
+void bench_print(const struct bench_result *r)
+{
+     printf("%-28s %10.2f %10.2f %10.2f %10.2f %4d/%-3d\n", r->name, r->median_ns, r->mean_ns,
+            r->stddev_ns, r->min_ns, r->kept, r->total);
+     fflush(stdout);
+}
@@ -0,0 +1,56 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+#include <stdint.h>
+
+/*
+ * Minimal benchmark harness. A benchmark is a function that performs a
+ * given number of operations and returns the nanoseconds they took. The
+ * harness sizes the operation count so one sample takes about
+ * sample_ms, collects a number of samples, throws away outliers outside
+ * the Tukey fences (1.5 IQR beyond the quartiles) and summarizes the rest.
+ */
+
+/**
+ * @brief Run @p iters operations and return the elapsed nanoseconds.
+ */
+typedef uint64_t (*bench_fn)(void *ctx, uint64_t iters);
+
+struct bench_opts
+{
+     int samples;     /*samples kept before outlier rejection*/
+     double sample_ms; /*target duration of one sample*/
+};
+
+struct bench_result
+{
+     const char *name;
+     double median_ns; /*per operation, after outlier rejection*/
+     double mean_ns;
+     double stddev_ns;
+     double min_ns;
+     int kept;
+     int total;
+};
+
+/**
+ * @brief Nanoseconds from CLOCK_MONOTONIC_RAW.
+ */
+uint64_t bench_now_ns(void);
+
+/**
+ * @brief Calibrate, sample and summarize @p fn into @p out.
+ */
+void bench_run(const char *name, bench_fn fn, void *ctx, const struct bench_opts *opts,
+               struct bench_result *out);
+
+/**
+ * @brief Print the column header for bench_print().
+ */
+void bench_print_header(void);
+
+/**
+ * @brief Print one result as a table row on stdout.
+ */
+void bench_print(const struct bench_result *r);
+
+#endif
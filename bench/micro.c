@@ -0,0 +1,307 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/lab.h"
+#include "gate.h"
+#include "harness.h"
+#include "scenarios.h"
+
+/*
+ * Per-call cost of the queue operations in src/lab.c:
+ *
+ *   uncontended  one thread calling a single operation in a loop
+ *   pingpong     two threads bouncing one item through a pair of queues;
+ *                reported per round trip
+ *   contended/N  N threads doing enqueue+dequeue pairs on one queue;
+ *                reported as wall time per pair over all threads
+ *
+ * followed by the app/main.c scenarios in bench/scenarios.c. With -o the
+ * results are saved as a baseline; with -c they are compared against one
+ * and the exit status is non-zero if anything regressed.
+ */
+
+#define MAX_THREADS 256
+
+static int dummy;
+
+/* a queue big enough that enqueue never blocks for iters items */
+static queue_t sized_queue(uint64_t iters)
+{
+     queue_t q = queue_init((int)iters);
+     if (!q)
+     {
+          fprintf(stderr, "ERROR: could not allocate a queue of %llu\n", (unsigned long long)iters);
+          exit(EXIT_FAILURE);
+     }
+     return q;
+}
+
+static uint64_t bench_enqueue(void *ctx, uint64_t iters)
+{
+     (void)ctx;
+     queue_t q = sized_queue(iters);
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+          enqueue(q, &dummy);
+     uint64_t ns = bench_now_ns() - t0;
+     queue_destroy(q);
+     return ns;
+}
+
+static uint64_t bench_dequeue(void *ctx, uint64_t iters)
+{
+     (void)ctx;
+     queue_t q = sized_queue(iters);
+     for (uint64_t i = 0; i < iters; i++)
+          enqueue(q, &dummy);
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+          dequeue(q);
+     uint64_t ns = bench_now_ns() - t0;
+     queue_destroy(q);
+     return ns;
+}
+
+static uint64_t bench_pair(void *ctx, uint64_t iters)
+{
+     queue_t q = (queue_t)ctx;
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+     {
+          enqueue(q, &dummy);
+          dequeue(q);
+     }
+     return bench_now_ns() - t0;
+}
+
+static uint64_t bench_is_empty(void *ctx, uint64_t iters)
+{
+     queue_t q = (queue_t)ctx;
+     int sink = 0;
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+          sink += is_empty(q);
+     uint64_t ns = bench_now_ns() - t0;
+     dummy += sink & 1;
+     return ns;
+}
+
+static uint64_t bench_is_shutdown(void *ctx, uint64_t iters)
+{
+     queue_t q = (queue_t)ctx;
+     int sink = 0;
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+          sink += is_shutdown(q);
+     uint64_t ns = bench_now_ns() - t0;
+     dummy += sink & 1;
+     return ns;
+}
+
+/* ---- ping-pong ---- */
+
+struct pingpong
+{
+     queue_t to_echo;
+     queue_t to_main;
+};
+
+static void *echo(void *args)
+{
+     struct pingpong *pp = (struct pingpong *)args;
+     void *itm;
+     while ((itm = dequeue(pp->to_echo)))
+          enqueue(pp->to_main, itm);
+     return NULL;
+}
+
+static uint64_t bench_pingpong(void *ctx, uint64_t iters)
+{
+     (void)ctx;
+     struct pingpong pp = {queue_init(1), queue_init(1)};
+     pthread_t t;
+     pthread_create(&t, NULL, echo, &pp);
+
+     /* one untimed round trip so the echo thread is running */
+     enqueue(pp.to_echo, &dummy);
+     dequeue(pp.to_main);
+
+     uint64_t t0 = bench_now_ns();
+     for (uint64_t i = 0; i < iters; i++)
+     {
+          enqueue(pp.to_echo, &dummy);
+          dequeue(pp.to_main);
+     }
+     uint64_t ns = bench_now_ns() - t0;
+
+     queue_shutdown(pp.to_echo);
+     pthread_join(t, NULL);
+     queue_destroy(pp.to_echo);
+     queue_destroy(pp.to_main);
+     return ns;
+}
+
+/* ---- N-way contention ---- */
+
+struct contended
+{
+     int nthreads;
+     queue_t q;
+     uint64_t per_thread;
+     pthread_barrier_t go;
+};
+
+static void *contender(void *args)
+{
+     struct contended *c = (struct contended *)args;
+     pthread_barrier_wait(&c->go);
+     for (uint64_t i = 0; i < c->per_thread; i++)
+     {
+          enqueue(c->q, &dummy);
+          dequeue(c->q);
+     }
+     return NULL;
+}
+
+static uint64_t bench_contended(void *ctx, uint64_t iters)
+{
+     struct contended *c = (struct contended *)ctx;
+     pthread_t t[MAX_THREADS];
+
+     /* capacity = threads, so enqueue+dequeue pairs never block */
+     c->q = queue_init(c->nthreads);
+     c->per_thread = (iters + c->nthreads - 1) / c->nthreads;
+     pthread_barrier_init(&c->go, NULL, c->nthreads + 1);
+     for (int i = 0; i < c->nthreads; i++)
+          pthread_create(&t[i], NULL, contender, c);
+
+     pthread_barrier_wait(&c->go);
+     uint64_t t0 = bench_now_ns();
+     for (int i = 0; i < c->nthreads; i++)
+          pthread_join(t[i], NULL);
+     uint64_t ns = bench_now_ns() - t0;
+
+     pthread_barrier_destroy(&c->go);
+     queue_destroy(c->q);
+     /* report per pair actually executed */
+     return (uint64_t)((double)ns * iters / (c->per_thread * c->nthreads));
+}
+
+static void usage(char *n)
+{
+     fprintf(stderr, "Usage: %s [-r samples] [-t ms per sample] [-n max threads] [-R scenario runs]\n"
+                     "          [-o baseline] [-c baseline] [-T threshold %%] [filter]\n", n);
+     fprintf(stderr, "Runs the queue microbenchmarks and scenarios whose name contains filter\n");
+     fprintf(stderr, "  -o FILE  save the results as a baseline\n");
+     fprintf(stderr, "  -c FILE  compare against a baseline, exit 1 on regression\n");
+     fprintf(stderr, "  -T PCT   slowdown that counts as a regression (default 20)\n");
+     exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+     struct bench_opts opts = {.samples = 21, .sample_ms = 5.0};
+     long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+     /* explicit -n values above MAX_THREADS are rejected, the default is clamped */
+     int max_threads = ncpu > MAX_THREADS ? MAX_THREADS : ncpu > 2 ? (int)ncpu : 2;
+     const char *filter = "";
+     const char *save = NULL, *compare = NULL;
+     double threshold = 20.0;
+     int reps = 5;
+     static struct metric_set results;
+     int c;
+
+     while ((c = getopt(argc, argv, "r:t:n:R:o:c:T:h")) != -1)
+          switch (c)
+          {
+          case 'r':
+               opts.samples = atoi(optarg);
+               break;
+          case 't':
+               opts.sample_ms = atof(optarg);
+               break;
+          case 'n':
+               max_threads = atoi(optarg);
+               break;
+          case 'R':
+               reps = atoi(optarg);
+               break;
+          case 'o':
+               save = optarg;
+               break;
+          case 'c':
+               compare = optarg;
+               break;
+          case 'T':
+               threshold = atof(optarg);
+               break;
+          default:
+               usage(argv[0]);
+          }
+     if (optind < argc)
+          filter = argv[optind];
+     if (opts.samples < 1 || opts.sample_ms <= 0 || max_threads < 2 || max_threads > MAX_THREADS || reps < 2 ||
+         threshold < 0)
+          usage(argv[0]);
+
+     static struct metric_set baseline;
+     if (compare && gate_load(&baseline, compare) != 0)
+          return EXIT_FAILURE;
+     gate_host(results.host, sizeof(results.host));
+
+     queue_t idle = queue_init(16);
+     struct bench_result r;
+     struct
+     {
+          const char *name;
+          bench_fn fn;
+          void *ctx;
+     } single[] = {
+         {"uncontended/enqueue", bench_enqueue, NULL},
+         {"uncontended/dequeue", bench_dequeue, NULL},
+         {"uncontended/enqueue+dequeue", bench_pair, idle},
+         {"uncontended/is_empty", bench_is_empty, idle},
+         {"uncontended/is_shutdown", bench_is_shutdown, idle},
+         {"pingpong/roundtrip", bench_pingpong, NULL},
+     };
+
+     bench_print_header();
+     for (size_t i = 0; i < sizeof(single) / sizeof(single[0]); i++)
+     {
+          if (!strstr(single[i].name, filter))
+               continue;
+          bench_run(single[i].name, single[i].fn, single[i].ctx, &opts, &r);
+          bench_print(&r);
+          gate_add(&results, r.name, "ns", false, r.kept, r.mean_ns, r.stddev_ns);
+     }
+
+     static char names[16][32];
+     int k = 0;
+     for (int n = 2; n <= max_threads && k < 16; n *= 2, k++)
+     {
+          snprintf(names[k], sizeof(names[k]), "contended/%d", n);
+          if (!strstr(names[k], filter))
+               continue;
+          struct contended ctx = {.nthreads = n};
+          bench_run(names[k], bench_contended, &ctx, &opts, &r);
+          bench_print(&r);
+          gate_add(&results, r.name, "ns", false, r.kept, r.mean_ns, r.stddev_ns);
+     }
+
+     queue_destroy(idle);
+
+     printf("\n");
+     if (scenarios_run(&results, filter, reps) != 0)
+          return EXIT_FAILURE;
+     if (save && gate_save(&results, save) != 0)
+          return EXIT_FAILURE;
+     if (compare)
+     {
+          printf("\n");
+          if (gate_compare(&baseline, &results, threshold) > 0)
+               return EXIT_FAILURE;
+     }
+     return 0;
+}
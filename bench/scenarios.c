@@ -0,0 +1,87 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "../app/sim.h"
+#include "scenarios.h"
+
+/*
+ * End-to-end runs through sim_run(), the same code path as app/main.c.
+ * Kept short so the regression gate finishes in a few seconds.
+ */
+
+struct scenario
+{
+     const char *name;
+     int producers;
+     int consumers;
+     int items;
+     int queue_size;
+     int batch;
+};
+
+static const struct scenario scenarios[] = {
+    {"app/1p1c/q64", 1, 1, 200000, 64, 1},
+    {"app/4p4c/q16", 4, 4, 200000, 16, 1},
+    {"app/4p4c/q16/batch8", 4, 4, 200000, 16, 8},
+    {"app/8p1c/q4", 8, 1, 100000, 4, 1},
+};
+
+static void summarize(const double *v, int n, double *mean, double *stddev)
+{
+     double sum = 0, sq = 0;
+     for (int i = 0; i < n; i++)
+          sum += v[i];
+     *mean = sum / n;
+     for (int i = 0; i < n; i++)
+          sq += (v[i] - *mean) * (v[i] - *mean);
+     *stddev = n > 1 ? sqrt(sq / (n - 1)) : 0.0;
+}
+
+int scenarios_run(struct metric_set *set, const char *filter, int reps)
+{
+     double throughput[reps], p99[reps];
+
+     for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+     {
+          const struct scenario *s = &scenarios[i];
+          if (!strstr(s->name, filter))
+               continue;
+
+          struct sim_config cfg = {
+              .producers = s->producers,
+              .consumers = s->consumers,
+              .items = s->items,
+              .queue_size = s->queue_size,
+              .batch = s->batch,
+              .seed = 1,
+          };
+          struct sim_result res;
+
+          /* rep -1 is the warmup */
+          for (int r = -1; r < reps; r++)
+          {
+               if (sim_run(&cfg, &res) != 0 || !res.checksum_ok)
+               {
+                    fprintf(stderr, "ERROR: scenario %s failed\n", s->name);
+                    return -1;
+               }
+               if (r < 0)
+                    continue;
+               throughput[r] = res.produced / (res.elapsed_ms / 1000.0);
+               p99[r] = hist_percentile(&res.latency, 99.0) / 1000.0;
+          }
+
+          char name[GATE_NAME_LEN];
+          double mean, stddev;
+          summarize(throughput, reps, &mean, &stddev);
+          snprintf(name, sizeof(name), "%s/throughput", s->name);
+          gate_add(set, name, "items/s", true, reps, mean, stddev);
+          printf("%-32s %12.0f items/s  +- %.0f\n", name, mean, stddev);
+
+          summarize(p99, reps, &mean, &stddev);
+          snprintf(name, sizeof(name), "%s/p99", s->name);
+          gate_add(set, name, "us", false, reps, mean, stddev);
+          printf("%-32s %12.1f us       +- %.1f\n", name, mean, stddev);
+     }
+     return 0;
+}
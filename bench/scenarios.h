@@ -0,0 +1,14 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+#include "gate.h"
+
+/**
+ * @brief Run the fixed set of producer/consumer scenarios from app/main.c
+ * whose name contains @p filter, @p reps times each after one warmup run,
+ * and add their throughput and p99 latency to @p set.
+ *
+ * @return 0 on success, -1 if a run failed or lost items
+ */
+int scenarios_run(struct metric_set *set, const char *filter, int reps);
+
+#endif
@@ -0,0 +1,165 @@
+#include "coalesce.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// A FIFO ring of (key, payload) entries plus an open-addressing index from
+// key to ring slot. Entries never move in the ring, so the index stores
+// slot numbers and a merge is a lookup and a pointer store. The index has
+// at least twice as many buckets as the ring has slots, uses linear
+// probing, and deletes by shifting later entries back instead of leaving
+// tombstones, so probe lengths stay short however long the queue runs.
+
+typedef struct {
+    uint64_t key;
+    void *payload;
+} entry;
+
+typedef struct coalesce_queue {
+    entry *ring;
+    int max_size;
+    int count;
+    int head;
+    int *index;                // ring slot per bucket, -1 if empty
+    unsigned mask;             // buckets - 1
+    coalesce_merge_fn merge;
+    void *ctx;
+    bool is_closed;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond_not_full;
+    pthread_cond_t cond_not_empty;
+} coalesce_queue;
+
+static unsigned bucket_of(coalesce_queue_t q, uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (unsigned)key & q->mask;
+}
+
+// bucket holding key, or the empty bucket where it would go
+static unsigned find(coalesce_queue_t q, uint64_t key) {
+    unsigned b = bucket_of(q, key);
+    while (q->index[b] >= 0 && q->ring[q->index[b]].key != key)
+        b = (b + 1) & q->mask;
+    return b;
+}
+
+// backward-shift delete: pull later members of the probe run into the hole
+static void unindex(coalesce_queue_t q, unsigned hole) {
+    unsigned b = hole;
+    for (;;) {
+        b = (b + 1) & q->mask;
+        if (q->index[b] < 0) break;
+        unsigned home = bucket_of(q, q->ring[q->index[b]].key);
+        // move b into the hole unless its home lies cyclically in (hole, b]
+        if (((b - home) & q->mask) >= ((b - hole) & q->mask)) {
+            q->index[hole] = q->index[b];
+            hole = b;
+        }
+    }
+    q->index[hole] = -1;
+}
+
+coalesce_queue_t coalesce_queue_init(int capacity, coalesce_merge_fn merge, void *ctx) {
+    if (capacity < 1 || capacity > (1 << 29)) return NULL;
+    coalesce_queue_t q = calloc(1, sizeof(struct coalesce_queue));
+    if (!q) return NULL;
+
+    unsigned buckets = 2;
+    while (buckets < 2u * (unsigned)capacity) buckets <<= 1;
+    q->ring = malloc(sizeof(entry) * capacity);
+    q->index = malloc(sizeof(int) * buckets);
+    if (!q->ring || !q->index) {
+        free(q->ring);
+        free(q->index);
+        free(q);
+        return NULL;
+    }
+    for (unsigned i = 0; i < buckets; i++) q->index[i] = -1;
+    q->mask = buckets - 1;
+    q->max_size = capacity;
+    q->merge = merge;
+    q->ctx = ctx;
+
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cond_not_full, NULL);
+    pthread_cond_init(&q->cond_not_empty, NULL);
+    return q;
+}
+
+void coalesce_queue_destroy(coalesce_queue_t q) {
+    if (!q) return;
+    pthread_mutex_destroy(&q->mtx);
+    pthread_cond_destroy(&q->cond_not_full);
+    pthread_cond_destroy(&q->cond_not_empty);
+    free(q->index);
+    free(q->ring);
+    free(q);
+}
+
+bool enqueue_coalesce(coalesce_queue_t q, uint64_t key, void *data) {
+    pthread_mutex_lock(&q->mtx);
+    for (;;) {
+        if (q->is_closed) {
+            pthread_mutex_unlock(&q->mtx);
+            return false;
+        }
+        unsigned b = find(q, key);
+        if (q->index[b] >= 0) {
+            entry *e = &q->ring[q->index[b]];
+            e->payload = q->merge ? q->merge(e->payload, data, q->ctx) : data;
+            pthread_mutex_unlock(&q->mtx);
+            return true;
+        }
+        if (q->count < q->max_size) {
+            int slot = (q->head + q->count) % q->max_size;
+            q->ring[slot].key = key;
+            q->ring[slot].payload = data;
+            q->index[b] = slot;
+            q->count++;
+            break;
+        }
+        // full: wait, then look again since the key may have been added meanwhile
+        pthread_cond_wait(&q->cond_not_full, &q->mtx);
+    }
+    pthread_cond_signal(&q->cond_not_empty);
+    pthread_mutex_unlock(&q->mtx);
+    return false;
+}
+
+void *dequeue_coalesce(coalesce_queue_t q, uint64_t *key) {
+    pthread_mutex_lock(&q->mtx);
+    while (q->count == 0) {
+        if (q->is_closed) {
+            pthread_mutex_unlock(&q->mtx);
+            return NULL;
+        }
+        pthread_cond_wait(&q->cond_not_empty, &q->mtx);
+    }
+
+    entry e = q->ring[q->head];
+    unindex(q, find(q, e.key));
+    q->head = (q->head + 1) % q->max_size;
+    q->count--;
+
+    pthread_cond_signal(&q->cond_not_full);
+    pthread_mutex_unlock(&q->mtx);
+    if (key) *key = e.key;
+    return e.payload;
+}
+
+void coalesce_queue_shutdown(coalesce_queue_t q) {
+    pthread_mutex_lock(&q->mtx);
+    q->is_closed = true;
+    pthread_cond_broadcast(&q->cond_not_empty);
+    pthread_cond_broadcast(&q->cond_not_full);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+int coalesce_pending(coalesce_queue_t q) {
+    pthread_mutex_lock(&q->mtx);
+    int n = q->count;
+    pthread_mutex_unlock(&q->mtx);
+    return n;
+}
@@ -0,0 +1,85 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a queue that keeps at most one
+     * pending element per key
+     */
+    typedef struct coalesce_queue *coalesce_queue_t;
+
+    /**
+     * @brief Combine an update with the one already pending for its key.
+     *
+     * @param pending the payload waiting in the queue
+     * @param incoming the payload being enqueued
+     * @param ctx the pointer given to coalesce_queue_init()
+     * @return the payload to keep pending; the caller of enqueue_coalesce()
+     * gives up whichever one is not returned, so free it here if needed
+     */
+    typedef void *(*coalesce_merge_fn)(void *pending, void *incoming, void *ctx);
+
+    /**
+     * @brief Initialize a coalescing queue. Enqueueing a key that is already
+     * pending updates that element in place and keeps its position, so the
+     * backlog is bounded by distinct keys rather than by update rate.
+     *
+     * @param capacity the maximum number of distinct pending keys
+     * @param merge combines updates for the same key, or NULL to keep the newest
+     * @param ctx passed to @p merge
+     * @return A fully initialized queue, or NULL on failure
+     */
+    coalesce_queue_t coalesce_queue_init(int capacity, coalesce_merge_fn merge, void *ctx);
+
+    /**
+     * @brief Frees the queue. No thread may still be using it.
+     *
+     * @param q a queue to free
+     */
+    void coalesce_queue_destroy(coalesce_queue_t q);
+
+    /**
+     * @brief Adds an update for @p key. If the key is pending it is merged
+     * and never blocks; otherwise it goes to the back of the queue,
+     * blocking while the queue is full.
+     *
+     * @param q the queue
+     * @param key identifies what the update is for
+     * @param data the payload
+     * @return true if merged into a pending element, false if added or shut down
+     */
+    bool enqueue_coalesce(coalesce_queue_t q, uint64_t key, void *data);
+
+    /**
+     * @brief Removes the element that has been pending longest.
+     *
+     * @param q the queue
+     * @param key set to the element's key, may be NULL
+     * @return the payload, or NULL once the queue is shut down and drained
+     */
+    void *dequeue_coalesce(coalesce_queue_t q, uint64_t *key);
+
+    /**
+     * @brief Set the shutdown flag and wake all waiting threads.
+     *
+     * @param q The queue
+     */
+    void coalesce_queue_shutdown(coalesce_queue_t q);
+
+    /**
+     * @brief Number of distinct keys pending.
+     *
+     * @param q The queue
+     */
+    int coalesce_pending(coalesce_queue_t q);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
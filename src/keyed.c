@@ -0,0 +1,155 @@
+#include "keyed.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// P small rings behind one lock. A partition is "ready" when it has items
+// and no owner; ready partitions sit on a FIFO list so idle consumers pick
+// them up round robin. Claiming a partition takes one item and marks it
+// owned, and only keyed_release() puts it back on the list, which is what
+// keeps items with the same key from being processed concurrently.
+
+typedef struct {
+    int head;
+    int count;
+    bool owned;
+    bool ready;                // on the ready list
+    int next_ready;            // next partition on the ready list, -1 at the end
+    pthread_cond_t not_full;
+} partition;
+
+typedef struct keyed_queue {
+    void **data;               // partitions * capacity slots
+    partition *parts;
+    int partitions;
+    int capacity;
+    int ready_head;            // -1 when no partition is ready
+    int ready_tail;
+    long total;                // items in all partitions
+    bool is_closed;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond_ready;
+} keyed_queue;
+
+keyed_queue_t keyed_queue_init(int partitions, int capacity) {
+    if (partitions < 1 || capacity < 1) return NULL;
+    keyed_queue_t q = calloc(1, sizeof(struct keyed_queue));
+    if (!q) return NULL;
+
+    q->data = malloc(sizeof(void *) * (size_t)partitions * capacity);
+    q->parts = calloc(partitions, sizeof(partition));
+    if (!q->data || !q->parts) {
+        free(q->data);
+        free(q->parts);
+        free(q);
+        return NULL;
+    }
+    q->partitions = partitions;
+    q->capacity = capacity;
+    q->ready_head = q->ready_tail = -1;
+    for (int i = 0; i < partitions; i++) pthread_cond_init(&q->parts[i].not_full, NULL);
+
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cond_ready, NULL);
+    return q;
+}
+
+void keyed_queue_destroy(keyed_queue_t q) {
+    if (!q) return;
+    for (int i = 0; i < q->partitions; i++) pthread_cond_destroy(&q->parts[i].not_full);
+    pthread_mutex_destroy(&q->mtx);
+    pthread_cond_destroy(&q->cond_ready);
+    free(q->parts);
+    free(q->data);
+    free(q);
+}
+
+int keyed_partition(keyed_queue_t q, uint64_t key) {
+    // splitmix64 finalizer, so sequential ids spread over the partitions
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return (int)(key % (uint64_t)q->partitions);
+}
+
+// caller holds mtx; p has items and no owner
+static void make_ready(keyed_queue_t q, int p) {
+    partition *part = &q->parts[p];
+    part->ready = true;
+    part->next_ready = -1;
+    if (q->ready_tail >= 0) q->parts[q->ready_tail].next_ready = p;
+    else q->ready_head = p;
+    q->ready_tail = p;
+    pthread_cond_signal(&q->cond_ready);
+}
+
+void enqueue_keyed(keyed_queue_t q, uint64_t key, void *data) {
+    int p = keyed_partition(q, key);
+    partition *part = &q->parts[p];
+    pthread_mutex_lock(&q->mtx);
+
+    while (part->count == q->capacity && !q->is_closed)
+        pthread_cond_wait(&part->not_full, &q->mtx);
+    if (q->is_closed) {
+        pthread_mutex_unlock(&q->mtx);
+        return;
+    }
+
+    q->data[(size_t)p * q->capacity + (part->head + part->count) % q->capacity] = data;
+    part->count++;
+    q->total++;
+    if (!part->owned && !part->ready) make_ready(q, p);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+void *dequeue_keyed(keyed_queue_t q, int *partition_out) {
+    pthread_mutex_lock(&q->mtx);
+
+    // with items left in owned partitions, wait for their release
+    while (q->ready_head < 0) {
+        if (q->is_closed && q->total == 0) {
+            pthread_mutex_unlock(&q->mtx);
+            *partition_out = -1;
+            return NULL;
+        }
+        pthread_cond_wait(&q->cond_ready, &q->mtx);
+    }
+
+    int p = q->ready_head;
+    partition *part = &q->parts[p];
+    q->ready_head = part->next_ready;
+    if (q->ready_head < 0) q->ready_tail = -1;
+    part->ready = false;
+    part->owned = true;
+
+    void *out = q->data[(size_t)p * q->capacity + part->head];
+    part->head = (part->head + 1) % q->capacity;
+    part->count--;
+    q->total--;
+    pthread_cond_signal(&part->not_full);
+
+    // last item handed out: let the other consumers see the drain
+    if (q->is_closed && q->total == 0) pthread_cond_broadcast(&q->cond_ready);
+    pthread_mutex_unlock(&q->mtx);
+    *partition_out = p;
+    return out;
+}
+
+void keyed_release(keyed_queue_t q, int p) {
+    if (p < 0 || p >= q->partitions) return;
+    pthread_mutex_lock(&q->mtx);
+    partition *part = &q->parts[p];
+    part->owned = false;
+    if (part->count > 0 && !part->ready) make_ready(q, p);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+void keyed_queue_shutdown(keyed_queue_t q) {
+    pthread_mutex_lock(&q->mtx);
+    q->is_closed = true;
+    pthread_cond_broadcast(&q->cond_ready);
+    for (int i = 0; i < q->partitions; i++) pthread_cond_broadcast(&q->parts[i].not_full);
+    pthread_mutex_unlock(&q->mtx);
+}
@@ -0,0 +1,86 @@
+#ifndef KEYED_H
+#define KEYED_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a queue split into partitions by
+     * key, where each partition is handed to at most one consumer at a time
+     */
+    typedef struct keyed_queue *keyed_queue_t;
+
+    /**
+     * @brief Initialize a partitioned queue. Items with the same key always
+     * land in the same partition and are handed out in FIFO order, one at a
+     * time; different partitions are processed in parallel.
+     *
+     * @param partitions number of partitions, e.g. a few per consumer
+     * @param capacity the maximum capacity of each partition
+     * @return A fully initialized queue, or NULL on failure
+     */
+    keyed_queue_t keyed_queue_init(int partitions, int capacity);
+
+    /**
+     * @brief Frees the queue. No thread may still be using it.
+     *
+     * @param q a queue to free
+     */
+    void keyed_queue_destroy(keyed_queue_t q);
+
+    /**
+     * @brief Adds an element to the back of the partition @p key hashes to.
+     * Blocks while that partition is full.
+     *
+     * @param q the queue
+     * @param key the ordering key, e.g. a customer id
+     * @param data the data to add
+     */
+    void enqueue_keyed(keyed_queue_t q, uint64_t key, void *data);
+
+    /**
+     * @brief Claims a non-empty partition that no other consumer owns and
+     * removes its front element. The caller owns the partition until it
+     * calls keyed_release(), so no other consumer sees a later element
+     * with the same key before this one is handled. Blocks while no
+     * partition can be claimed.
+     *
+     * @param q the queue
+     * @param partition set to the claimed partition
+     * @return the element, or NULL once the queue is shut down and drained
+     */
+    void *dequeue_keyed(keyed_queue_t q, int *partition);
+
+    /**
+     * @brief Gives up ownership of a partition claimed by dequeue_keyed(),
+     * making its remaining elements available to any consumer.
+     *
+     * @param q the queue
+     * @param partition the partition returned by dequeue_keyed()
+     */
+    void keyed_release(keyed_queue_t q, int partition);
+
+    /**
+     * @brief Set the shutdown flag and wake all waiting threads. Consumers
+     * keep draining until every partition is empty.
+     *
+     * @param q The queue
+     */
+    void keyed_queue_shutdown(keyed_queue_t q);
+
+    /**
+     * @brief Partition that @p key maps to.
+     *
+     * @param q The queue
+     * @param key the ordering key
+     */
+    int keyed_partition(keyed_queue_t q, uint64_t key);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -1,37 +1,186 @@
 #include "lab.h"
+#include "spill.h"
+#include "wheel.h"
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 // all public functions begin and end with a mutex lock
 // Enqueue blocks on full queue or shutdown; dequeue blocks only on empty
 
+#ifndef LAB_NO_STATS
+// Counters live in cache-line sized shards picked per thread, so recording
+// them never makes threads fight over a shared line. Build with
+// -DLAB_NO_STATS to compile all of this out.
+#define STATS_SHARDS 16
+
+typedef struct {
+    _Atomic uint64_t enqueued;
+    _Atomic uint64_t dequeued;
+    _Atomic uint64_t enqueue_blocked;
+    _Atomic uint64_t dequeue_blocked;
+    _Atomic uint64_t enqueue_wait_ns;
+    _Atomic uint64_t dequeue_wait_ns;
+    _Atomic uint64_t enqueue_wait_max_ns;
+    _Atomic uint64_t dequeue_wait_max_ns;
+    _Atomic uint64_t lock_contended;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t spilled;
+    _Atomic uint64_t handed_off;
+    _Atomic uint64_t occupancy[QUEUE_OCCUPANCY_BUCKETS];
+} __attribute__((aligned(64))) stats_shard;
+
+static _Atomic unsigned next_shard;
+static _Thread_local unsigned my_shard = -1u;
+
+static stats_shard *shard_of(stats_shard *shards) {
+    if (my_shard == -1u)
+        my_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % STATS_SHARDS;
+    return &shards[my_shard];
+}
+
+#define STAT_ADD(q, field, n) \
+    atomic_fetch_add_explicit(&shard_of((q)->stats)->field, (n), memory_order_relaxed)
+#define STAT_MAX(q, field, v) stat_max(&shard_of((q)->stats)->field, (v))
+#define STAT_OCCUPANCY(q) \
+    STAT_ADD(q, occupancy[(uint64_t)(q)->count * QUEUE_OCCUPANCY_BUCKETS / ((uint64_t)(q)->max_size + 1)], 1)
+#define STAT_CLOCK(t) uint64_t t = now_ns()
+
+static void stat_max(_Atomic uint64_t *slot, uint64_t v) {
+    uint64_t cur = atomic_load_explicit(slot, memory_order_relaxed);
+    while (v > cur &&
+           !atomic_compare_exchange_weak_explicit(slot, &cur, v, memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+#define now_ns queue_now_ns
+#else
+#define STAT_ADD(q, field, n) ((void)0)
+#define STAT_MAX(q, field, v) ((void)0)
+#define STAT_OCCUPANCY(q) ((void)0)
+#define STAT_CLOCK(t) ((void)0)
+#endif
+
+// One slot of the overwrite ring. seq is 2t+1 while ticket t is being
+// written and 2t+2 once it is readable, so a reader can tell a stale,
+// half-written or overwritten slot from the one it wants.
+typedef struct {
+    _Atomic uint64_t seq;
+    void *_Atomic item;
+} ow_slot;
+
+// A consumer parked in dequeue() on an empty queue. A producer gives its
+// item to the oldest one directly, skipping the ring, and signals only that
+// consumer's condition, so no other consumer wakes up to find nothing.
+typedef struct handoff {
+    struct handoff *next;
+    void *item;
+    bool filled;
+    pthread_cond_t cond;
+} handoff;
+
+// First page of a mapped queue's file; the slots follow on the next page.
+// head and tail only ever grow and are each stored with one 8-byte write,
+// so whatever point a crash hits, the file holds a consistent pair.
+#define RING_MAGIC 0x3170614d62614cull   // "LabMap1"
+#define RING_HEADER_BYTES 4096
+
+typedef struct {
+    uint64_t magic;
+    uint64_t capacity;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+} ring_header;
+
 typedef struct queue {
     void **data;               //array of any pointer
-    int max_size;
-    int count;
-    int head;
-    int tail;
-    bool is_closed;           // shutdown flag
+    size_t max_size;
+    size_t count;
+    uint64_t head;             // items ever removed; slot is head % max_size
+    uint64_t tail;             // items ever added
+    _Atomic bool is_closed;   // shutdown flag, read without the lock by overwrite producers
+    size_t mapped_bytes;      // size of the mmap holding queue and ring, 0 if malloc'd
+    size_t ring_bytes;        // size of the ring's own mmap (queue_init_flags), 0 otherwise
+    bool in_place;            // queue and ring live in the caller's buffer
+
+    queue_overflow_t policy;
+    queue_evict_fn on_evict;
+    void *evict_ctx;
+
+    // QUEUE_OVERWRITE only: tickets for the lock-free ring, on their own lines
+    ow_slot *ring;
+    _Alignas(64) _Atomic uint64_t ow_tail;
+    _Alignas(64) _Atomic uint64_t ow_head;
+    _Atomic int sleepers;     // consumers waiting on cond_not_empty
+
+    wheel_t wheel;            // delayed items, created by the first enqueue_at
+    spill_t spill;            // QUEUE_SPILL only: items behind a full ring
+
+    ring_header *hdr;         // mapped queues only: start of the file mapping
+    size_t file_bytes;
+    uint64_t synced_tail;     // slots below this tail were already handed to msync
+    int file_fd;
+    queue_msync_t msync_policy;
+
+    queue_allocator_t alloc;  // where the struct, ring and helpers came from
+
+    // parked dequeue() calls, oldest first; only ever non-empty while count is 0
+    handoff *waiters;
+    handoff **waiters_tail;
 
     pthread_mutex_t mtx;
     pthread_cond_t cond_not_full;
     pthread_cond_t cond_not_empty;
+#ifndef LAB_NO_STATS
+    stats_shard stats[STATS_SHARDS];
+#endif
 } queue;
 
-//initialize queue with specified capacity
-queue_t queue_init(int max_elements) {
-    queue_t q = malloc(sizeof(struct queue));
-    if (!q) return NULL;
+// lock the queue, counting how often somebody else already held it
+static void queue_lock(queue_t q) {
+#ifndef LAB_NO_STATS
+    if (pthread_mutex_trylock(&q->mtx) == 0) return;
+    STAT_ADD(q, lock_contended, 1);
+#endif
+    pthread_mutex_lock(&q->mtx);
+}
 
-    q->data = malloc(sizeof(void *) * max_elements);
+static void *libc_alloc(size_t bytes, void *ctx) {
+    (void)ctx;
+    return malloc(bytes);
+}
 
-    //check memory allocation
-    if (!q->data) {
-        free(q);
-        return NULL;
-    }
+static void libc_free(void *ptr, size_t bytes, void *ctx) {
+    (void)bytes;
+    (void)ctx;
+    free(ptr);
+}
 
+static void *libc_aligned_alloc(size_t align, size_t bytes, void *ctx) {
+    (void)ctx;
+    return aligned_alloc(align, bytes);
+}
+
+const queue_allocator_t queue_malloc_allocator = {libc_alloc, libc_free, libc_aligned_alloc, NULL};
+
+// fill in a zeroed queue whose ring has already been allocated
+static void queue_setup(queue_t q, void **data, size_t max_elements) {
+    if (!q->alloc.alloc) q->alloc = queue_malloc_allocator;
+    q->waiters = NULL;
+    q->waiters_tail = &q->waiters;
+    q->data = data;
     q->max_size = max_elements;
     q->count = 0;
     q->head = 0;
@@ -41,10 +190,293 @@ queue_t queue_init(int max_elements) {
     pthread_mutex_init(&q->mtx, NULL);
     pthread_cond_init(&q->cond_not_full, NULL);
     pthread_cond_init(&q->cond_not_empty, NULL);
+}
+
+//initialize queue with specified capacity
+queue_t queue_init(int max_elements) {
+    return queue_init_ex(max_elements, &queue_malloc_allocator);
+}
+
+queue_t queue_init_ex(int max_elements, const queue_allocator_t *alloc) {
+    if (max_elements < 1) return NULL;
+    if (!alloc) alloc = &queue_malloc_allocator;
+    queue_t q = alloc->aligned_alloc(_Alignof(struct queue), sizeof(struct queue), alloc->ctx);
+    if (!q) return NULL;
+    memset(q, 0, sizeof(struct queue));
+    q->alloc = *alloc;
+
+    void **data = alloc->alloc(sizeof(void *) * max_elements, alloc->ctx);
+
+    //check memory allocation
+    if (!data) {
+        alloc->free(q, sizeof(struct queue), alloc->ctx);
+        return NULL;
+    }
+
+    queue_setup(q, data, max_elements);
+    return q;
+}
+
+size_t queue_required_size(size_t max_elements) {
+    size_t fixed = sizeof(struct queue) + _Alignof(struct queue) - 1;
+    if (max_elements < 1 || max_elements > (SIZE_MAX - fixed) / sizeof(void *)) return 0;
+    return fixed + sizeof(void *) * max_elements;
+}
+
+// the buffer need not be aligned; queue_required_size leaves room to fix that
+queue_t queue_init_inplace(void *buf, size_t bytes, size_t max_elements) {
+    size_t need = queue_required_size(max_elements);
+    if (!buf || need == 0 || bytes < need) return NULL;
+
+    uintptr_t align = _Alignof(struct queue);
+    queue_t q = (queue_t)(((uintptr_t)buf + align - 1) & ~(align - 1));
+    memset(q, 0, sizeof(struct queue));
+    q->in_place = true;
+    queue_setup(q, (void **)(q + 1), max_elements);
+    return q;
+}
+
+#define HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+// anonymous mapping for a ring of bytes; see queue_init_flags for flags
+static void **map_ring(size_t bytes, unsigned flags) {
+    int prot = PROT_READ | PROT_WRITE, anon = MAP_PRIVATE | MAP_ANONYMOUS;
+    char *mem = MAP_FAILED;
+    // explicit hugepages only exist if the admin reserved some
+    if (flags & QUEUE_HUGEPAGES) mem = mmap(NULL, bytes, prot, anon | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED && (flags & QUEUE_HUGEPAGES)) {
+        // otherwise ask for transparent ones; they need 2MB aligned extents,
+        // so over-map by one and trim both ends
+        char *raw = mmap(NULL, bytes + HUGE_PAGE_BYTES, prot, anon, -1, 0);
+        if (raw == MAP_FAILED) return NULL;
+        mem = (char *)(((uintptr_t)raw + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        if (mem > raw) munmap(raw, mem - raw);
+        munmap(mem + bytes, raw + HUGE_PAGE_BYTES - mem);
+        madvise(mem, bytes, MADV_HUGEPAGE);
+    } else if (mem == MAP_FAILED) {
+        mem = mmap(NULL, bytes, prot, anon, -1, 0);
+        if (mem == MAP_FAILED) return NULL;
+    }
+
+    if (flags & QUEUE_PREFAULT) {
+        // a write per page, so neither the fault nor the zeroing happens
+        // under the queue lock later
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < bytes; off += page) ((volatile char *)mem)[off] = 0;
+    }
+    if ((flags & QUEUE_MLOCK) && mlock(mem, bytes) != 0) {
+        munmap(mem, bytes);
+        return NULL;
+    }
+    return (void **)mem;
+}
+
+queue_t queue_init_flags(size_t max_elements, unsigned flags) {
+    if (max_elements < 1 || max_elements > (SIZE_MAX - HUGE_PAGE_BYTES) / sizeof(void *))
+        return NULL;
+    queue_t q = aligned_alloc(_Alignof(struct queue), sizeof(struct queue));
+    if (!q) return NULL;
+    memset(q, 0, sizeof(struct queue));
+
+    size_t bytes = sizeof(void *) * max_elements;
+    if (flags & QUEUE_HUGEPAGES) bytes = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    void **data = map_ring(bytes, flags);
+    if (!data) {
+        free(q);
+        return NULL;
+    }
+    q->ring_bytes = bytes;
+    queue_setup(q, data, max_elements);
+    return q;
+}
+
+#define MPOL_PREFERRED 1     // from <linux/mempolicy.h>
+#define NUMA_MASK_WORDS 16   // room for 1024 nodes
+
+// queue and ring in one mapping, with its pages preferring node
+queue_t queue_init_numa(int max_elements, int node) {
+    if (max_elements < 1 || node >= NUMA_MASK_WORDS * 64) return NULL;
+
+    size_t bytes = sizeof(struct queue) + sizeof(void *) * (size_t)max_elements;
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
 
+    // bind before anything touches the pages, so first touch lands on node
+    if (node >= 0) {
+        unsigned long mask[NUMA_MASK_WORDS] = {0};
+        mask[node / 64] = 1ul << (node % 64);
+        if (syscall(SYS_mbind, mem, bytes, MPOL_PREFERRED, mask,
+                    (unsigned long)NUMA_MASK_WORDS * 64, 0) != 0 && errno != ENOSYS) {
+            munmap(mem, bytes);
+            return NULL;
+        }
+    }
+
+    // fresh anonymous pages are already zero
+    queue_t q = mem;
+    q->mapped_bytes = bytes;
+    queue_setup(q, (void **)(q + 1), max_elements);
     return q;
 }
 
+queue_t queue_open_mapped(const char *path, int max_elements, queue_msync_t policy) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+
+    // the mutex and conditions are per process, so only one may attach
+    struct stat st;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &st) != 0) goto fail;
+
+    ring_header h = {0};
+    bool fresh = st.st_size == 0;
+    if (fresh) {
+        if (max_elements < 1) goto fail;
+        h.capacity = max_elements;
+    } else if (pread(fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != RING_MAGIC ||
+               h.capacity < 1 || h.capacity > (SIZE_MAX - RING_HEADER_BYTES) / sizeof(void *) ||
+               (max_elements > 0 && h.capacity != (uint64_t)max_elements)) {
+        goto fail;
+    }
+
+    size_t bytes = RING_HEADER_BYTES + sizeof(void *) * h.capacity;
+    if (fresh ? ftruncate(fd, bytes) != 0 : (size_t)st.st_size < bytes) goto fail;
+    ring_header *hdr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) goto fail;
+
+    queue_t q = aligned_alloc(_Alignof(struct queue), sizeof(struct queue));
+    if (!q) {
+        munmap(hdr, bytes);
+        goto fail;
+    }
+    memset(q, 0, sizeof(struct queue));
+    queue_setup(q, (void **)((char *)hdr + RING_HEADER_BYTES), h.capacity);
+    q->hdr = hdr;
+    q->file_bytes = bytes;
+    q->file_fd = fd;
+    q->msync_policy = policy;
+
+    if (fresh) {
+        // magic last, so a crash here leaves a file that is rejected, not misread
+        hdr->capacity = h.capacity;
+        atomic_store(&hdr->head, 0);
+        atomic_store(&hdr->tail, 0);
+        hdr->magic = RING_MAGIC;
+        msync(hdr, RING_HEADER_BYTES, MS_SYNC);
+    } else {
+        q->head = atomic_load(&hdr->head);
+        q->tail = atomic_load(&hdr->tail);
+        if (q->tail < q->head || q->tail - q->head > h.capacity) {
+            queue_destroy(q);
+            return NULL;
+        }
+        q->count = q->tail - q->head;
+    }
+    q->synced_tail = q->tail;
+    return q;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+int queue_msync(queue_t q) {
+    if (!q->hdr) return 0;
+    return msync(q->hdr, q->file_bytes, MS_SYNC);
+}
+
+// msync the pages holding slots [first, first + n) of the ring
+static void sync_slots(queue_t q, size_t first, size_t n, int flags) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    char *from = (char *)((uintptr_t)(q->data + first) & ~(page - 1));
+    msync(from, (char *)(q->data + first + n) - from, flags);
+}
+
+// msync the slots written since the last call; every write lands at the tail
+static void sync_written(queue_t q, int flags) {
+    uint64_t n = q->tail - q->synced_tail;
+    q->synced_tail = q->tail;
+    if (n == 0) return;
+    if (n >= q->max_size) {
+        sync_slots(q, 0, q->max_size, flags);
+        return;
+    }
+    size_t first = (q->tail - n) % q->max_size;
+    size_t run = n < q->max_size - first ? n : q->max_size - first;
+    sync_slots(q, first, run, flags);
+    if (run < n) sync_slots(q, 0, n - run, flags);
+}
+
+// with the lock held, after head or tail moved: mirror them into the file.
+// Only an evicting enqueue moves both. Head goes first, so a crash between
+// the two stores loses the new item along with the evicted one; the other
+// order would leave tail more than a ring ahead of head, and reopening
+// rejects such a file.
+static void persist(queue_t q) {
+    if (!q->hdr) return;
+    // slots must reach the disk before the cursor that covers them
+    if (q->msync_policy == QUEUE_MSYNC_SYNC) sync_written(q, MS_SYNC);
+    atomic_store_explicit(&q->hdr->head, q->head, memory_order_release);
+    atomic_store_explicit(&q->hdr->tail, q->tail, memory_order_release);
+    if (q->msync_policy == QUEUE_MSYNC_SYNC) {
+        msync(q->hdr, RING_HEADER_BYTES, MS_SYNC);
+    } else if (q->msync_policy == QUEUE_MSYNC_ASYNC) {
+        sync_written(q, MS_ASYNC);
+        msync(q->hdr, RING_HEADER_BYTES, MS_ASYNC);
+    }
+}
+
+// with the lock held: give elem to the longest parked dequeue, if any.
+// Waiters only park on an empty ring with nothing spilled, so this keeps
+// FIFO order.
+static bool hand_off(queue_t q, void *elem) {
+    handoff *w = q->waiters;
+    if (!w) return false;
+    q->waiters = w->next;
+    if (!q->waiters) q->waiters_tail = &q->waiters;
+    w->item = elem;
+    w->filled = true;
+    STAT_ADD(q, enqueued, 1);
+    STAT_ADD(q, handed_off, 1);
+    STAT_OCCUPANCY(q);
+    pthread_cond_signal(&w->cond);
+    return true;
+}
+
+// with the lock held, once closed: wake every parked dequeue empty-handed
+static void release_waiters(queue_t q) {
+    for (handoff *w = q->waiters; w; w = w->next)
+        pthread_cond_signal(&w->cond);
+    q->waiters = NULL;
+    q->waiters_tail = &q->waiters;
+}
+
+// with the lock held, on an empty open queue: wait in the handoff list until
+// a producer fills in our item or the queue is closed. Returns whether we
+// got an item.
+static bool park(queue_t q, void **out) {
+    STAT_CLOCK(start);
+    handoff w = {.next = NULL, .item = NULL, .filled = false};
+    pthread_cond_init(&w.cond, NULL);
+    *q->waiters_tail = &w;
+    q->waiters_tail = &w.next;
+    // counted once parked, so the stats show a consumer that is waiting
+    STAT_ADD(q, dequeue_blocked, 1);
+    // shutdown unlinks us before waking us
+    while (!w.filled && !q->is_closed)
+        pthread_cond_wait(&w.cond, &q->mtx);
+    pthread_cond_destroy(&w.cond);
+#ifndef LAB_NO_STATS
+    uint64_t waited = now_ns() - start;
+    STAT_ADD(q, dequeue_wait_ns, waited);
+    STAT_MAX(q, dequeue_wait_max_ns, waited);
+#endif
+    if (!w.filled) return false;
+    STAT_ADD(q, dequeued, 1);
+    STAT_OCCUPANCY(q);
+    *out = w.item;
+    return true;
+}
+
 // release resources and wake threads
 void queue_destroy(queue_t q) {
     if (!q) return;
@@ -53,75 +485,510 @@ void queue_destroy(queue_t q) {
     q->is_closed = true;
 
     // Wakes waiting threads
+    release_waiters(q);
     pthread_cond_broadcast(&q->cond_not_empty);
     pthread_cond_broadcast(&q->cond_not_full);
     pthread_mutex_unlock(&q->mtx);
 
+    // the timer thread sees the queue closed, so it cannot block in enqueue
+    wheel_destroy(q->wheel);
+
     pthread_mutex_destroy(&q->mtx);
     pthread_cond_destroy(&q->cond_not_full);
     pthread_cond_destroy(&q->cond_not_empty);
 
-    free(q->data);
-    free(q);
+    // copied out: the hooks may be about to free q itself
+    queue_allocator_t a = q->alloc;
+    if (q->ring) a.free(q->ring, sizeof(ow_slot) * q->max_size, a.ctx);
+    spill_close(q->spill);
+    if (q->hdr) {
+        // the ring is the file, there is nothing to free
+        munmap(q->hdr, q->file_bytes);
+        close(q->file_fd);
+        a.free(q, sizeof(struct queue), a.ctx);
+        return;
+    }
+    if (q->mapped_bytes) {
+        munmap(q, q->mapped_bytes);
+        return;
+    }
+    if (q->in_place) return;  // the caller owns the buffer
+    if (q->ring_bytes)
+        munmap(q->data, q->ring_bytes);
+    else
+        a.free(q->data, sizeof(void *) * q->max_size, a.ctx);
+    a.free(q, sizeof(struct queue), a.ctx);
+}
+
+int queue_set_overflow(queue_t q, queue_overflow_t policy, queue_evict_fn on_evict, void *ctx) {
+    queue_lock(q);
+    if (q->count > 0 || atomic_load(&q->ow_tail) != atomic_load(&q->ow_head)) {
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+
+    if (q->hdr && (policy == QUEUE_OVERWRITE || policy == QUEUE_SPILL)) {
+        // neither the ticket ring nor the spill file is in the mapping
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    if (policy == QUEUE_SPILL && !q->spill) {
+        // needs a directory, see queue_set_spill
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    if (policy == QUEUE_OVERWRITE && !q->ring) {
+        q->ring = q->alloc.alloc(sizeof(ow_slot) * q->max_size, q->alloc.ctx);
+        if (!q->ring) {
+            pthread_mutex_unlock(&q->mtx);
+            return -1;
+        }
+        memset(q->ring, 0, sizeof(ow_slot) * q->max_size);
+    }
+    q->policy = policy;
+    q->on_evict = on_evict;
+    q->evict_ctx = ctx;
+    pthread_mutex_unlock(&q->mtx);
+    return 0;
+}
+
+int queue_set_spill(queue_t q, const char *dir) {
+    queue_lock(q);
+    if (q->hdr || q->count > 0 || atomic_load(&q->ow_tail) != atomic_load(&q->ow_head)) {
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    if (!q->spill) q->spill = spill_open(dir, &q->alloc);
+    if (!q->spill) {
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    q->policy = QUEUE_SPILL;
+    pthread_mutex_unlock(&q->mtx);
+    return 0;
+}
+
+// ---- QUEUE_SPILL: the ring stays full while anything is on disk ----
+
+// with the lock held: true if elem must go behind the spilled items
+static bool must_spill(queue_t q) {
+    return q->policy == QUEUE_SPILL && (q->count == q->max_size || spill_count(q->spill) > 0);
+}
+
+static queue_status_t spill_put(queue_t q, void *elem) {
+    if (spill_push(q->spill, elem) != 0) {
+        STAT_ADD(q, dropped, 1);
+        return QUEUE_REJECTED;
+    }
+    STAT_ADD(q, enqueued, 1);
+    STAT_ADD(q, spilled, 1);
+    return QUEUE_OK;
+}
+
+// with the lock held, after a dequeue: move spilled items into the free slots
+static void refill(queue_t q) {
+    if (q->policy != QUEUE_SPILL) return;
+    void *elem;
+    while (q->count < q->max_size && spill_pop(q->spill, &elem)) {
+        q->data[q->tail % q->max_size] = elem;
+        q->tail++;
+        q->count++;
+    }
+    // values the spill file could not give back are lost, not pending
+    uint64_t lost = spill_take_lost(q->spill);
+    if (lost) STAT_ADD(q, dropped, lost);
+}
+
+// ---- QUEUE_OVERWRITE: producers claim tickets, consumers chase them ----
+
+// spin briefly, then give the CPU to whoever we are waiting for
+static void backoff(unsigned *spins) {
+    if (++*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return;
+    }
+    sched_yield();
+}
+
+static queue_status_t ow_push(queue_t q, void *elem) {
+    if (atomic_load_explicit(&q->is_closed, memory_order_acquire)) return QUEUE_CLOSED;
+
+    uint64_t t = atomic_fetch_add_explicit(&q->ow_tail, 1, memory_order_relaxed);
+    ow_slot *s = &q->ring[t % q->max_size];
+
+    // the writer one lap behind may still be mid-store; that is a few
+    // instructions, not a consumer, so waiting for it is bounded
+    uint64_t prev = t >= (uint64_t)q->max_size ? 2 * (t - q->max_size) + 2 : 0;
+    unsigned spins = 0;
+    while (atomic_load_explicit(&s->seq, memory_order_acquire) != prev)
+        backoff(&spins);
+
+    atomic_store_explicit(&s->seq, 2 * t + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&s->item, elem, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, 2 * t + 2, memory_order_release);
+    STAT_ADD(q, enqueued, 1);
+
+    // pairs with the increment in ow_wait: either the sleeper sees the item
+    // or we see the sleeper
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->sleepers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&q->mtx);
+        pthread_cond_signal(&q->cond_not_empty);
+        pthread_mutex_unlock(&q->mtx);
+    }
+    // the slot we reused still held an unread item
+    uint64_t cap = q->max_size;
+    if (t >= cap && atomic_load_explicit(&q->ow_head, memory_order_relaxed) <= t - cap)
+        return QUEUE_EVICTED;
+    return QUEUE_OK;
+}
+
+// take the oldest readable item, skipping anything already overwritten
+static bool ow_pop(queue_t q, void **out) {
+    uint64_t cap = q->max_size;
+    for (;;) {
+        uint64_t h = atomic_load_explicit(&q->ow_head, memory_order_acquire);
+        uint64_t t = atomic_load_explicit(&q->ow_tail, memory_order_acquire);
+        if (h >= t) return false;
+
+        if (t - h > cap) {
+            // lapped: everything before t - cap is gone
+            if (atomic_compare_exchange_weak_explicit(&q->ow_head, &h, t - cap,
+                                                      memory_order_acq_rel, memory_order_relaxed))
+                STAT_ADD(q, dropped, t - cap - h);
+            continue;
+        }
+
+        ow_slot *s = &q->ring[h % cap];
+        uint64_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        // older: claimed but not published yet, and its producer wakes
+        // sleepers once it is; newer: overwritten, the next pass sees the lap
+        if (seq < 2 * h + 2) return false;
+        if (seq != 2 * h + 2) continue;
+        void *item = atomic_load_explicit(&s->item, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) != seq) continue;
+
+        if (atomic_compare_exchange_weak_explicit(&q->ow_head, &h, h + 1,
+                                                  memory_order_acq_rel, memory_order_relaxed)) {
+            STAT_ADD(q, dequeued, 1);
+            *out = item;
+            return true;
+        }
+    }
+}
+
+// blocking ow_pop, returns false once shut down and drained
+static bool ow_wait(queue_t q, void **out) {
+    if (ow_pop(q, out)) return true;
+
+    queue_lock(q);
+    STAT_CLOCK(start);
+    bool got, waited = false;
+    atomic_fetch_add(&q->sleepers, 1);
+    while (!(got = ow_pop(q, out)) && !q->is_closed) {
+        waited = true;
+        pthread_cond_wait(&q->cond_not_empty, &q->mtx);
+    }
+    atomic_fetch_sub(&q->sleepers, 1);
+    pthread_mutex_unlock(&q->mtx);
+#ifndef LAB_NO_STATS
+    // the locked retry often finds an item; only count real waits
+    if (waited) {
+        uint64_t ns = now_ns() - start;
+        STAT_ADD(q, dequeue_blocked, 1);
+        STAT_ADD(q, dequeue_wait_ns, ns);
+        STAT_MAX(q, dequeue_wait_max_ns, ns);
+    }
+#else
+    (void)waited;
+#endif
+    return got;
+}
+
+// make room in a full queue per the policy, with the lock held.
+// Returns QUEUE_OK if the caller should block as usual.
+static queue_status_t overflow(queue_t q) {
+    if (q->policy == QUEUE_REJECT_NEW) {
+        STAT_ADD(q, dropped, 1);
+        return QUEUE_REJECTED;
+    }
+    if (q->policy == QUEUE_EVICT_OLDEST) {
+        void *old = q->data[q->head % q->max_size];
+        q->head++;
+        q->count--;
+        STAT_ADD(q, dropped, 1);
+        if (q->on_evict) q->on_evict(old, q->evict_ctx);
+        return QUEUE_EVICTED;
+    }
+    return QUEUE_OK;
 }
 
 // enqueue element. Blocks if the queue is full
 void enqueue(queue_t q, void *elem) {
-    pthread_mutex_lock(&q->mtx);
+    enqueue_status(q, elem);
+}
+
+// enqueue element, handling a full queue per the overflow policy
+queue_status_t enqueue_status(queue_t q, void *elem) {
+    if (q->policy == QUEUE_OVERWRITE) return ow_push(q, elem);
+    queue_status_t status = QUEUE_OK;
+    queue_lock(q);
 
         // when shutdown
         if (q->is_closed) {
             pthread_mutex_unlock(&q->mtx);
-            return;
+            return QUEUE_CLOSED;
         }
 
+    if (must_spill(q)) {
+        status = spill_put(q, elem);
+        pthread_mutex_unlock(&q->mtx);
+        return status;
+    }
+
+    if (q->count == q->max_size) status = overflow(q);
+    if (status == QUEUE_REJECTED) {
+        pthread_mutex_unlock(&q->mtx);
+        return status;
+    }
+
     //wait while the queue is full
-    while (q->count == q->max_size) {
-        //shutdown while waiting
-        if (q->is_closed) {
-            pthread_mutex_unlock(&q->mtx);
-            return;
+    if (q->count == q->max_size) {
+        STAT_CLOCK(start);
+        // counted before the wait, so the stats show a producer that is stuck
+        STAT_ADD(q, enqueue_blocked, 1);
+        while (q->count == q->max_size) {
+            //shutdown while waiting
+            if (q->is_closed) {
+                pthread_mutex_unlock(&q->mtx);
+                return QUEUE_CLOSED;
+            }
+            pthread_cond_wait(&q->cond_not_full, &q->mtx);
         }
-        pthread_cond_wait(&q->cond_not_full, &q->mtx);
+#ifndef LAB_NO_STATS
+        uint64_t waited = now_ns() - start;
+        STAT_ADD(q, enqueue_wait_ns, waited);
+        STAT_MAX(q, enqueue_wait_max_ns, waited);
+#endif
+    }
+
+    // a consumer is already waiting: it gets elem without a trip through the ring
+    if (hand_off(q, elem)) {
+        // we may have been woken for a slot we did not use; pass it on
+        pthread_cond_signal(&q->cond_not_full);
+        pthread_mutex_unlock(&q->mtx);
+        return status;
     }
 
     // enqueue element
-    q->data[q->tail] = elem;
-    q->tail = (q->tail + 1) % q->max_size;
+    q->data[q->tail % q->max_size] = elem;
+    q->tail++;
     q->count++;
+    STAT_ADD(q, enqueued, 1);
+    STAT_OCCUPANCY(q);
+    persist(q);
 
     pthread_cond_signal(&q->cond_not_empty);
     pthread_mutex_unlock(&q->mtx);
+    return status;
+}
+
+uint64_t queue_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// hand the element to the timer wheel until its deadline
+int enqueue_at(queue_t q, void *elem, uint64_t when_ns) {
+    if (when_ns <= queue_now_ns())
+        return enqueue_status(q, elem) == QUEUE_CLOSED ? -1 : 0;
+
+    queue_lock(q);
+    if (q->is_closed) {
+        pthread_mutex_unlock(&q->mtx);
+        return -1;
+    }
+    if (!q->wheel) q->wheel = wheel_create(q, &q->alloc);
+    wheel_t w = q->wheel;
+    pthread_mutex_unlock(&q->mtx);
+
+    return w ? wheel_add(w, elem, when_ns) : -1;
 }
 
 // Remove/return the front item. Waits if the queue is empty.
 void *dequeue(queue_t q) {
-    pthread_mutex_lock(&q->mtx);
+    if (q->policy == QUEUE_OVERWRITE) {
+        void *out;
+        return ow_wait(q, &out) ? out : NULL;
+    }
+    queue_lock(q);
 
-    // Wait while queue is empty
-    while (q->count == 0) {
-        //shutdown while waiting/empty
-        if (q->is_closed) {
-            pthread_mutex_unlock(&q->mtx);
-            return NULL;
-        }
-        pthread_cond_wait(&q->cond_not_empty, &q->mtx);
+    // Wait while queue is empty: park in the handoff list, where the next
+    // producer fills in our item directly
+    if (q->count == 0) {
+        void *out = NULL;
+        if (!q->is_closed) park(q, &out);
+        pthread_mutex_unlock(&q->mtx);
+        return out;
     }
 
     //remove/return front item
-    void *out = q->data[q->head];
-    q->head = (q->head + 1) % q->max_size;
+    void *out = q->data[q->head % q->max_size];
+    q->head++;
     q->count--;
+    STAT_ADD(q, dequeued, 1);
+    STAT_OCCUPANCY(q);
+    refill(q);
+    persist(q);
 
     pthread_cond_signal(&q->cond_not_full);
     pthread_mutex_unlock(&q->mtx);
     return out;
 }
 
+// remove the front item if there is one, never waits
+void *try_dequeue(queue_t q) {
+    if (q->policy == QUEUE_OVERWRITE) {
+        void *out;
+        return ow_pop(q, &out) ? out : NULL;
+    }
+    queue_lock(q);
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->mtx);
+        return NULL;
+    }
+
+    void *out = q->data[q->head % q->max_size];
+    q->head++;
+    q->count--;
+    STAT_ADD(q, dequeued, 1);
+    STAT_OCCUPANCY(q);
+    refill(q);
+    persist(q);
+
+    pthread_cond_signal(&q->cond_not_full);
+    pthread_mutex_unlock(&q->mtx);
+    return out;
+}
+
+// enqueue n elements, taking the lock once per stretch of free space
+int enqueue_batch(queue_t q, void **items, int n) {
+    int done = 0;
+    if (q->policy == QUEUE_OVERWRITE) {
+        while (done < n && ow_push(q, items[done]) != QUEUE_CLOSED) done++;
+        return done;
+    }
+    queue_lock(q);
+
+    while (done < n) {
+        if (must_spill(q) && !q->is_closed) {
+            if (spill_put(q, items[done]) == QUEUE_REJECTED) {
+                STAT_ADD(q, dropped, n - done - 1);
+                break;
+            }
+            done++;
+            continue;
+        }
+        if (q->count == q->max_size && !q->is_closed) {
+            queue_status_t status = overflow(q);
+            if (status == QUEUE_REJECTED) {
+                // count the rest of the batch as dropped too
+                STAT_ADD(q, dropped, n - done - 1);
+                break;
+            }
+        }
+        if (q->count == q->max_size) {
+            STAT_CLOCK(start);
+            while (q->count == q->max_size && !q->is_closed)
+                pthread_cond_wait(&q->cond_not_full, &q->mtx);
+#ifndef LAB_NO_STATS
+            uint64_t waited = now_ns() - start;
+            STAT_ADD(q, enqueue_blocked, 1);
+            STAT_ADD(q, enqueue_wait_ns, waited);
+            STAT_MAX(q, enqueue_wait_max_ns, waited);
+#endif
+        }
+        if (q->is_closed) break;
+
+        while (done < n && hand_off(q, items[done])) done++;
+        if (done == n) {
+            pthread_cond_signal(&q->cond_not_full);  // the free slot went unused
+            break;
+        }
+
+        int added = 0;
+        while (done < n && q->count < q->max_size) {
+            q->data[q->tail % q->max_size] = items[done++];
+            q->tail++;
+            q->count++;
+            added++;
+        }
+        STAT_ADD(q, enqueued, added);
+        STAT_OCCUPANCY(q);
+        persist(q);
+
+        if (added == 1)
+            pthread_cond_signal(&q->cond_not_empty);
+        else
+            pthread_cond_broadcast(&q->cond_not_empty);
+    }
+
+    pthread_mutex_unlock(&q->mtx);
+    return done;
+}
+
+// dequeue up to max elements. Waits only for the first one
+int dequeue_batch(queue_t q, void **out, int max) {
+    if (max <= 0) return 0;
+    if (q->policy == QUEUE_OVERWRITE) {
+        if (!ow_wait(q, &out[0])) return 0;
+        int n = 1;
+        while (n < max && ow_pop(q, &out[n])) n++;
+        return n;
+    }
+    queue_lock(q);
+
+    // empty: park like dequeue() and take the handed off item alone; the
+    // next call picks up whatever piled up in the ring meanwhile
+    if (q->count == 0) {
+        int n = !q->is_closed && park(q, &out[0]) ? 1 : 0;
+        pthread_mutex_unlock(&q->mtx);
+        return n;
+    }
+
+    int n = 0;
+    while (n < max && q->count > 0) {
+        out[n++] = q->data[q->head % q->max_size];
+        q->head++;
+        q->count--;
+        // keep going into whatever was spilled behind the ring
+        if (q->count == 0) refill(q);
+    }
+    if (n > 0) {
+        STAT_ADD(q, dequeued, n);
+        STAT_OCCUPANCY(q);
+        refill(q);
+        persist(q);
+        if (n == 1)
+            pthread_cond_signal(&q->cond_not_full);
+        else
+            pthread_cond_broadcast(&q->cond_not_full);
+    }
+
+    pthread_mutex_unlock(&q->mtx);
+    return n;
+}
+
 // graceful exit on all threads through broadcast. new dequeue threads can be created
 void queue_shutdown(queue_t q) {
-    pthread_mutex_lock(&q->mtx);
+    queue_lock(q);
     q->is_closed = true;
+    release_waiters(q);
     pthread_cond_broadcast(&q->cond_not_empty);
     pthread_cond_broadcast(&q->cond_not_full);
     pthread_mutex_unlock(&q->mtx);
@@ -129,7 +996,9 @@ void queue_shutdown(queue_t q) {
 
 // Return true if empty
 bool is_empty(queue_t q) {
-    pthread_mutex_lock(&q->mtx);
+    if (q->policy == QUEUE_OVERWRITE)
+        return atomic_load(&q->ow_head) >= atomic_load(&q->ow_tail);
+    queue_lock(q);
     bool result = (q->count == 0);
     pthread_mutex_unlock(&q->mtx);
     return result;
@@ -137,8 +1006,38 @@ bool is_empty(queue_t q) {
 
 // returns shutdown bool
 bool is_shutdown(queue_t q) {
-    pthread_mutex_lock(&q->mtx);
+    queue_lock(q);
     bool status = q->is_closed;
     pthread_mutex_unlock(&q->mtx);
     return status;
 }
+
+// sum the per-thread shards into one snapshot
+void queue_stats(queue_t q, queue_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+#ifndef LAB_NO_STATS
+    for (int i = 0; i < STATS_SHARDS; i++) {
+        stats_shard *s = &q->stats[i];
+        out->enqueued += atomic_load_explicit(&s->enqueued, memory_order_relaxed);
+        out->dequeued += atomic_load_explicit(&s->dequeued, memory_order_relaxed);
+        out->enqueue_blocked += atomic_load_explicit(&s->enqueue_blocked, memory_order_relaxed);
+        out->dequeue_blocked += atomic_load_explicit(&s->dequeue_blocked, memory_order_relaxed);
+        out->enqueue_wait_ns += atomic_load_explicit(&s->enqueue_wait_ns, memory_order_relaxed);
+        out->dequeue_wait_ns += atomic_load_explicit(&s->dequeue_wait_ns, memory_order_relaxed);
+        out->lock_contended += atomic_load_explicit(&s->lock_contended, memory_order_relaxed);
+        out->dropped += atomic_load_explicit(&s->dropped, memory_order_relaxed);
+        out->spilled += atomic_load_explicit(&s->spilled, memory_order_relaxed);
+        out->handed_off += atomic_load_explicit(&s->handed_off, memory_order_relaxed);
+
+        uint64_t m = atomic_load_explicit(&s->enqueue_wait_max_ns, memory_order_relaxed);
+        if (m > out->enqueue_wait_max_ns) out->enqueue_wait_max_ns = m;
+        m = atomic_load_explicit(&s->dequeue_wait_max_ns, memory_order_relaxed);
+        if (m > out->dequeue_wait_max_ns) out->dequeue_wait_max_ns = m;
+
+        for (int b = 0; b < QUEUE_OCCUPANCY_BUCKETS; b++)
+            out->occupancy[b] += atomic_load_explicit(&s->occupancy[b], memory_order_relaxed);
+    }
+#else
+    (void)q;
+#endif
+}
@@ -2,6 +2,7 @@
 #define LAB_H
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -13,6 +14,81 @@ extern "C"
      */
     typedef struct queue *queue_t;
 
+    /**
+     * @brief number of buckets in the occupancy histogram. Bucket i counts
+     * operations that left the queue between i/N and (i+1)/N full.
+     */
+#define QUEUE_OCCUPANCY_BUCKETS 10
+
+    /**
+     * @brief snapshot of the counters kept by a queue. All zero when the
+     * library is built with LAB_NO_STATS.
+     */
+    typedef struct
+    {
+        uint64_t enqueued;            // items added
+        uint64_t dequeued;            // items removed
+        uint64_t enqueue_blocked;     // enqueue calls that waited on a full queue
+        uint64_t dequeue_blocked;     // dequeue calls that waited on an empty queue
+        uint64_t enqueue_wait_ns;     // total time spent waiting in enqueue
+        uint64_t dequeue_wait_ns;     // total time spent waiting in dequeue
+        uint64_t enqueue_wait_max_ns; // longest single wait in enqueue
+        uint64_t dequeue_wait_max_ns; // longest single wait in dequeue
+        uint64_t lock_contended;      // lock acquisitions that found the mutex held
+        uint64_t dropped;             // items lost to the overflow policy
+        uint64_t spilled;             // items written to the spill file
+        uint64_t handed_off;          // items given straight to a waiting dequeue
+        uint64_t occupancy[QUEUE_OCCUPANCY_BUCKETS];
+    } queue_stats_t;
+
+    /**
+     * @brief what enqueue does when the queue is full
+     */
+    typedef enum
+    {
+        QUEUE_BLOCK = 0,    // wait for a free slot (the default)
+        QUEUE_REJECT_NEW,   // drop the item being added
+        QUEUE_EVICT_OLDEST, // drop the item at the front to make room
+        QUEUE_OVERWRITE,    // lock-free ring, producers overwrite the oldest slot
+        QUEUE_SPILL,        // append to a file, see queue_set_spill()
+    } queue_overflow_t;
+
+    /**
+     * @brief outcome of enqueue_status()
+     */
+    typedef enum
+    {
+        QUEUE_OK = 0,   // added
+        QUEUE_REJECTED, // the queue was full and the item was not added
+        QUEUE_EVICTED,  // added after dropping the front item
+        QUEUE_CLOSED,   // the queue is shut down and the item was not added
+    } queue_status_t;
+
+    /**
+     * @brief called with each item dropped by QUEUE_EVICT_OLDEST, e.g. to
+     * free it. Runs with the queue locked and must not call back into it.
+     */
+    typedef void (*queue_evict_fn)(void *item, void *ctx);
+
+    /**
+     * @brief memory hooks for queue_init_ex. Every hook gets the allocator's
+     * ctx, and free also gets the size that was asked for, so arena and
+     * slab allocators need no headers of their own.
+     */
+    typedef struct
+    {
+        void *(*alloc)(size_t bytes, void *ctx);
+        void (*free)(void *ptr, size_t bytes, void *ctx);
+        void *(*aligned_alloc)(size_t align, size_t bytes, void *ctx);
+        void *ctx;
+    } queue_allocator_t;
+
+    /**
+     * @brief the hooks used by every other constructor: malloc, free and
+     * aligned_alloc.
+     */
+    extern const queue_allocator_t queue_malloc_allocator;
+
     /**
      * @brief Initialize a new queue
      *
@@ -21,6 +97,138 @@ extern "C"
      */
     queue_t queue_init(int capacity);
 
+    /**
+     * @brief Initialize a new queue whose control block, ring, stats and
+     * any later overwrite ring, timing wheel or spill buffers all come
+     * from @p alloc. The hooks are copied, ctx is not; it must outlive the
+     * queue.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @param alloc the hooks, or NULL for queue_malloc_allocator
+     * @return A fully initialized queue, or NULL on failure
+     */
+    queue_t queue_init_ex(int capacity, const queue_allocator_t *alloc);
+
+    /**
+     * @brief Bytes queue_init_inplace needs for @p capacity items, including
+     * slack for aligning an unaligned buffer.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return the size, or 0 if @p capacity is 0 or too large
+     */
+    size_t queue_required_size(size_t capacity);
+
+    /**
+     * @brief Initialize a queue and its ring inside @p buf, e.g. static
+     * storage or a field of another struct. Nothing is allocated, and
+     * queue_destroy leaves @p buf to the caller; it must stay put until
+     * then. Overwrite rings, delayed items and spilling still allocate
+     * with malloc when first used.
+     *
+     * @param buf the memory to use
+     * @param bytes size of @p buf, at least queue_required_size(capacity)
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue inside @p buf, or NULL if it does not fit
+     */
+    queue_t queue_init_inplace(void *buf, size_t bytes, size_t capacity);
+
+    /**
+     * @brief Initialize a new queue whose control block and ring are
+     * allocated on NUMA node @p node. Uses mbind(2) with a preferred policy,
+     * so memory still comes from another node if @p node is exhausted.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @param node the NUMA node to allocate on, or -1 for the caller's node
+     * @return A fully initialized queue, or NULL on failure
+     */
+    queue_t queue_init_numa(int capacity, int node);
+
+    // flags for queue_init_flags
+#define QUEUE_HUGEPAGES 0x1u // back the ring with 2MB pages
+#define QUEUE_PREFAULT 0x2u  // touch every page of the ring before returning
+#define QUEUE_MLOCK 0x4u     // lock the ring in RAM; fails past RLIMIT_MEMLOCK
+
+    /**
+     * @brief Initialize a new queue whose ring is its own anonymous mapping,
+     * for capacities in the millions and beyond 2^31. With QUEUE_HUGEPAGES
+     * the ring uses MAP_HUGETLB if hugepages are reserved and falls back to
+     * transparent hugepages (MADV_HUGEPAGE) if not.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @param flags any of QUEUE_HUGEPAGES, QUEUE_PREFAULT and QUEUE_MLOCK
+     * @return A fully initialized queue, or NULL on failure
+     */
+    queue_t queue_init_flags(size_t capacity, unsigned flags);
+
+    /**
+     * @brief Choose what happens when an item is added to a full queue.
+     * Must be called before the queue is shared between threads.
+     *
+     * With QUEUE_OVERWRITE producers never lock or wait: each enqueue claims
+     * the next slot of the ring, and consumers skip whatever was overwritten
+     * before they got to it. Items lost that way are never handed back, so
+     * use it for values that need no cleanup, such as latest readings.
+     *
+     * @param q an empty queue
+     * @param policy the overflow policy
+     * @param on_evict called with items dropped by QUEUE_EVICT_OLDEST, may be NULL
+     * @param ctx passed to @p on_evict
+     * @return 0 on success, -1 if the queue is not empty or out of memory
+     */
+    int queue_set_overflow(queue_t q, queue_overflow_t policy, queue_evict_fn on_evict, void *ctx);
+
+    /**
+     * @brief Switch to QUEUE_SPILL: once the ring is full, new items go to
+     * an unlinked temporary file in @p dir, written in large sequential
+     * chunks, and are read back in order as consumers make room. Producers
+     * never wait for consumers and memory stays bounded. Only the pointer
+     * values are stored, so items must stay valid until dequeued. If the
+     * file cannot be written the item is rejected and counted as dropped.
+     * Must be called before the queue is shared between threads.
+     *
+     * @param q an empty queue
+     * @param dir directory for the spill file
+     * @return 0 on success, -1 if the queue is not empty or the file could
+     * not be created
+     */
+    int queue_set_spill(queue_t q, const char *dir);
+
+    /**
+     * @brief when a mapped queue forces its file to disk
+     */
+    typedef enum
+    {
+        QUEUE_MSYNC_NONE = 0, // leave it to the page cache: survives a process crash
+        QUEUE_MSYNC_ASYNC,    // start writeback after every operation
+        QUEUE_MSYNC_SYNC,     // wait for the disk after every operation: survives power loss
+    } queue_msync_t;
+
+    /**
+     * @brief Open a queue whose ring and head/tail cursors live in @p path,
+     * mapped with MAP_SHARED. A new or empty file is initialized; an
+     * existing one is reattached as is, so restart time does not depend on
+     * the backlog. Only pointer values are stored, so use it for values
+     * that mean the same in the next process (indexes, offsets, ids).
+     * The file is locked while open. Not compatible with QUEUE_OVERWRITE
+     * or QUEUE_SPILL.
+     *
+     * @param path the backing file, created if missing
+     * @param capacity capacity for a new file; for an existing file it must
+     * match, or be 0 to take the stored one
+     * @param policy how eagerly changes are forced to disk
+     * @return A fully initialized queue, or NULL if the file is in use,
+     * corrupt, or does not match @p capacity
+     */
+    queue_t queue_open_mapped(const char *path, int capacity, queue_msync_t policy);
+
+    /**
+     * @brief Force a mapped queue's file to disk now, whatever its policy.
+     *
+     * @param q the queue
+     * @return 0 on success or if @p q is not mapped, -1 on failure
+     */
+    int queue_msync(queue_t q);
+
     /**
      * @brief Frees all memory and related data signals all waiting threads.
      *
@@ -29,13 +237,45 @@ extern "C"
     void queue_destroy(queue_t q);
 
     /**
-     * @brief Adds an element to the back of the queue
+     * @brief Adds an element to the back of the queue, applying the overflow
+     * policy if it is full
      *
      * @param q the queue
      * @param data the data to add
      */
     void enqueue(queue_t q, void *data);
 
+    /**
+     * @brief Adds an element to the back of the queue, applying the overflow
+     * policy if it is full.
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @return whether the element was added and what was dropped
+     */
+    queue_status_t enqueue_status(queue_t q, void *data);
+
+    /**
+     * @brief Adds an element that stays invisible to dequeue until
+     * @p when_ns. A timer thread, started on the first call, moves due
+     * elements to the back of the queue with enqueue(); until then they
+     * cost one pooled node each and no wakeups. Deadlines are rounded up
+     * to 1 ms, and elements still pending when the queue is destroyed are
+     * dropped.
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @param when_ns deadline on the queue_now_ns() clock; past deadlines
+     * enqueue immediately
+     * @return 0 on success, -1 if the queue is shut down or out of memory
+     */
+    int enqueue_at(queue_t q, void *data, uint64_t when_ns);
+
+    /**
+     * @brief The clock used by enqueue_at(): CLOCK_MONOTONIC in nanoseconds.
+     */
+    uint64_t queue_now_ns(void);
+
     /**
      * @brief Removes the first element in the queue.
      *
@@ -43,6 +283,40 @@ extern "C"
      */
     void *dequeue(queue_t q);
 
+    /**
+     * @brief Removes the first element in the queue without waiting.
+     *
+     * @param q the queue
+     * @return the element, or NULL if the queue is empty
+     */
+    void *try_dequeue(queue_t q);
+
+    /**
+     * @brief Adds @p n elements to the back of the queue under one lock
+     * acquisition per wait, blocking while the queue is full. Under
+     * QUEUE_REJECT_NEW it adds what fits and never waits.
+     *
+     * @param q the queue
+     * @param items the elements to add, in order
+     * @param n number of elements in @p items
+     * @return how many were added; less than @p n only if the queue was shut
+     * down or items were rejected
+     */
+    int enqueue_batch(queue_t q, void **items, int n);
+
+    /**
+     * @brief Removes up to @p max elements from the front of the queue.
+     * Waits only until at least one element is available. On an empty
+     * queue it parks in the handoff list like dequeue() and returns the
+     * single item handed to it.
+     *
+     * @param q the queue
+     * @param out where to store the removed elements
+     * @param max capacity of @p out
+     * @return how many were removed; 0 once the queue is shut down and empty
+     */
+    int dequeue_batch(queue_t q, void **out, int max);
+
     /**
      * @brief Set the shutdown flag in the queue so all threads can
      * complete and exit properly
@@ -65,6 +339,16 @@ extern "C"
      */
     bool is_shutdown(queue_t q);
 
+    /**
+     * @brief Copies the queue's counters into @p out. Counters are kept in
+     * per-thread shards, so the snapshot is not atomic with respect to
+     * concurrent operations.
+     *
+     * @param q The queue
+     * @param out where to write the snapshot
+     */
+    void queue_stats(queue_t q, queue_stats_t *out);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,199 @@
+#ifndef LAB_HPP
+#define LAB_HPP
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+// Header-only typed counterpart of queue_t. Items are stored inline in a
+// fixed ring, so nothing is allocated per item and move-only types work.
+// Blocking and shutdown semantics match src/lab.c: push blocks while full,
+// pop blocks while empty, and after shutdown pop drains what is left.
+
+namespace lab
+{
+    template <typename T, std::size_t Capacity>
+    class queue
+    {
+        static_assert(Capacity > 0, "queue capacity must be positive");
+        static_assert(std::is_nothrow_move_constructible_v<T>,
+                      "queue items must be nothrow move constructible");
+
+    public:
+        queue() = default;
+        queue(const queue &) = delete;
+        queue &operator=(const queue &) = delete;
+
+        ~queue()
+        {
+            while (count_ > 0)
+            {
+                slot(head_)->~T();
+                head_ = next(head_);
+                count_--;
+            }
+        }
+
+        static constexpr std::size_t capacity() noexcept { return Capacity; }
+
+        /**
+         * @brief Constructs an item in place at the back of the queue.
+         * Blocks while the queue is full.
+         *
+         * @return false if the queue was shut down and nothing was added
+         */
+        template <typename... Args>
+        bool emplace(Args &&...args)
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            not_full_.wait(lk, [this]
+                           { return closed_ || count_ < Capacity; });
+            if (closed_)
+                return false;
+            ::new (static_cast<void *>(slot(tail_))) T(std::forward<Args>(args)...);
+            tail_ = next(tail_);
+            count_++;
+            lk.unlock();
+            not_empty_.notify_one();
+            return true;
+        }
+
+        bool push(const T &item) { return emplace(item); }
+        bool push(T &&item) { return emplace(std::move(item)); }
+
+        /**
+         * @brief Removes the front item. Blocks while the queue is empty.
+         *
+         * @return the item, or std::nullopt once shut down and drained
+         */
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            not_empty_.wait(lk, [this]
+                            { return closed_ || count_ > 0; });
+            if (count_ == 0)
+                return std::nullopt;
+            std::optional<T> out(take());
+            lk.unlock();
+            not_full_.notify_one();
+            return out;
+        }
+
+        /**
+         * @brief Moves as many items from @p items as fit right now, blocking
+         * only until at least one slot is free.
+         *
+         * @return the number of items moved in; 0 if shut down or @p items is empty
+         */
+        std::size_t push(std::span<T> items)
+        {
+            if (items.empty())
+                return 0;
+            std::unique_lock<std::mutex> lk(mtx_);
+            not_full_.wait(lk, [this]
+                           { return closed_ || count_ < Capacity; });
+            if (closed_)
+                return 0;
+            std::size_t n = 0;
+            while (n < items.size() && count_ < Capacity)
+            {
+                ::new (static_cast<void *>(slot(tail_))) T(std::move(items[n++]));
+                tail_ = next(tail_);
+                count_++;
+            }
+            lk.unlock();
+            if (n == 1)
+                not_empty_.notify_one();
+            else
+                not_empty_.notify_all();
+            return n;
+        }
+
+        /**
+         * @brief Moves up to out.size() items into @p out, blocking only until
+         * at least one is available.
+         *
+         * @return the number of items written; 0 once shut down and drained
+         */
+        std::size_t pop(std::span<T> out)
+        {
+            if (out.empty())
+                return 0;
+            std::unique_lock<std::mutex> lk(mtx_);
+            not_empty_.wait(lk, [this]
+                            { return closed_ || count_ > 0; });
+            std::size_t n = 0;
+            while (n < out.size() && count_ > 0)
+                out[n++] = take();
+            lk.unlock();
+            if (n == 1)
+                not_full_.notify_one();
+            else if (n > 1)
+                not_full_.notify_all();
+            return n;
+        }
+
+        void shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                closed_ = true;
+            }
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+        bool is_empty() const
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            return count_ == 0;
+        }
+
+        bool is_shutdown() const
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            return closed_;
+        }
+
+    private:
+        // Capacity is a constant, so the modulo folds to a mask or a
+        // multiply for any size.
+        static constexpr std::size_t next(std::size_t i) noexcept { return (i + 1) % Capacity; }
+
+        T *slot(std::size_t i) noexcept
+        {
+            return std::launder(reinterpret_cast<T *>(storage_[i].bytes));
+        }
+
+        // caller holds mtx_ and count_ > 0
+        T take() noexcept
+        {
+            T *p = slot(head_);
+            T out(std::move(*p));
+            p->~T();
+            head_ = next(head_);
+            count_--;
+            return out;
+        }
+
+        struct cell
+        {
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+
+        mutable std::mutex mtx_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::size_t head_ = 0;
+        std::size_t tail_ = 0;
+        std::size_t count_ = 0;
+        bool closed_ = false;
+        cell storage_[Capacity];
+    };
+} // namespace lab
+
+#endif
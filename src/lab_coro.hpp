@@ -0,0 +1,364 @@
+#ifndef LAB_CORO_HPP
+#define LAB_CORO_HPP
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// C++20 coroutine flavor of the queue. A coroutine that has to wait is not
+// parked in pthread_cond_wait; its awaiter is linked onto a waiter list
+// inside the queue and the coroutine is resumed on a scheduler thread once
+// an item (pop) or a slot (push) is available.
+//
+//   lab::scheduler sched(4);
+//   lab::async_queue<int, 128> q(sched);
+//   ... inside a coroutine:
+//   while (auto v = co_await q.pop()) handle(*v);
+
+namespace lab
+{
+    /**
+     * @brief Small pool of threads that resume coroutine handles in FIFO order.
+     */
+    class scheduler
+    {
+    public:
+        explicit scheduler(unsigned nthreads = std::thread::hardware_concurrency())
+        {
+            if (nthreads == 0)
+                nthreads = 1;
+            workers_.reserve(nthreads);
+            for (unsigned i = 0; i < nthreads; i++)
+                workers_.emplace_back([this]
+                                      { run(); });
+        }
+
+        scheduler(const scheduler &) = delete;
+        scheduler &operator=(const scheduler &) = delete;
+
+        // Runs everything already posted, then stops the workers.
+        ~scheduler()
+        {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                stopping_ = true;
+            }
+            cv_.notify_all();
+            for (auto &t : workers_)
+                t.join();
+        }
+
+        void post(std::coroutine_handle<> h)
+        {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                ready_.push_back(h);
+            }
+            cv_.notify_one();
+        }
+
+        /**
+         * @brief co_await sched.schedule() moves the calling coroutine onto
+         * one of the scheduler threads.
+         */
+        auto schedule()
+        {
+            struct awaiter
+            {
+                scheduler &s;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) { s.post(h); }
+                void await_resume() const noexcept {}
+            };
+            return awaiter{*this};
+        }
+
+    private:
+        void run()
+        {
+            for (;;)
+            {
+                std::unique_lock<std::mutex> lk(mtx_);
+                cv_.wait(lk, [this]
+                         { return stopping_ || !ready_.empty(); });
+                if (ready_.empty())
+                    return;
+                std::coroutine_handle<> h = ready_.front();
+                ready_.pop_front();
+                lk.unlock();
+                h.resume();
+            }
+        }
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<std::coroutine_handle<>> ready_;
+        bool stopping_ = false;
+        std::vector<std::thread> workers_;
+    };
+
+    /**
+     * @brief Coroutine return type for fire-and-forget consumers/producers.
+     * The body starts running immediately and the frame frees itself when
+     * it finishes.
+     */
+    struct detached
+    {
+        struct promise_type
+        {
+            detached get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    template <typename T, std::size_t Capacity>
+    class async_queue
+    {
+        static_assert(Capacity > 0, "queue capacity must be positive");
+        static_assert(std::is_nothrow_move_constructible_v<T>,
+                      "queue items must be nothrow move constructible");
+
+    public:
+        class pop_awaiter;
+        class push_awaiter;
+
+        explicit async_queue(scheduler &sched) : sched_(sched) {}
+        async_queue(const async_queue &) = delete;
+        async_queue &operator=(const async_queue &) = delete;
+
+        ~async_queue()
+        {
+            while (count_ > 0)
+                take();
+        }
+
+        /**
+         * @brief co_await q.pop() yields the front item, or std::nullopt once
+         * the queue is shut down and drained.
+         */
+        pop_awaiter pop() noexcept { return pop_awaiter(*this); }
+
+        /**
+         * @brief co_await q.push(x) yields true once x is queued (or handed
+         * straight to a waiting consumer), false if the queue was shut down.
+         */
+        push_awaiter push(T item) noexcept { return push_awaiter(*this, std::move(item)); }
+
+        // Resumes every parked coroutine: pushers get false, poppers drain
+        // whatever is left and then get std::nullopt.
+        void shutdown()
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            closed_ = true;
+            waiter *pushers = pushers_.release();
+            waiter *poppers = poppers_.release();
+            lk.unlock();
+            resume_all(pushers);
+            resume_all(poppers);
+        }
+
+        bool is_empty() const
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            return count_ == 0;
+        }
+
+        bool is_shutdown() const
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            return closed_;
+        }
+
+    private:
+        // Intrusive node embedded in each awaiter, so parking a coroutine
+        // never allocates.
+        struct waiter
+        {
+            waiter *next = nullptr;
+            std::coroutine_handle<> handle;
+        };
+
+        struct waiter_list
+        {
+            waiter *head = nullptr;
+            waiter *tail = nullptr;
+
+            bool empty() const noexcept { return head == nullptr; }
+
+            void push_back(waiter *w) noexcept
+            {
+                w->next = nullptr;
+                if (tail)
+                    tail->next = w;
+                else
+                    head = w;
+                tail = w;
+            }
+
+            waiter *pop_front() noexcept
+            {
+                waiter *w = head;
+                head = w->next;
+                if (!head)
+                    tail = nullptr;
+                return w;
+            }
+
+            waiter *release() noexcept
+            {
+                waiter *w = head;
+                head = tail = nullptr;
+                return w;
+            }
+        };
+
+    public:
+        class pop_awaiter : waiter
+        {
+        public:
+            explicit pop_awaiter(async_queue &q) noexcept : q_(q) {}
+
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                std::unique_lock<std::mutex> lk(q_.mtx_);
+                if (q_.count_ > 0)
+                {
+                    result_.emplace(q_.take());
+                    // a slot just opened: move the oldest parked pusher in
+                    push_awaiter *p = nullptr;
+                    if (!q_.pushers_.empty())
+                    {
+                        p = static_cast<push_awaiter *>(q_.pushers_.pop_front());
+                        q_.put(std::move(p->item_));
+                        p->ok_ = true;
+                    }
+                    lk.unlock();
+                    if (p)
+                        q_.sched_.post(p->handle);
+                    return false;
+                }
+                if (q_.closed_)
+                    return false;
+                this->handle = h;
+                q_.poppers_.push_back(this);
+                return true;
+            }
+
+            std::optional<T> await_resume() noexcept { return std::move(result_); }
+
+        private:
+            friend class async_queue;
+            async_queue &q_;
+            std::optional<T> result_;
+        };
+
+        class push_awaiter : waiter
+        {
+        public:
+            push_awaiter(async_queue &q, T &&item) noexcept : q_(q), item_(std::move(item)) {}
+
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                std::unique_lock<std::mutex> lk(q_.mtx_);
+                if (q_.closed_)
+                    return false;
+                // the ring is empty whenever a popper is parked, so hand the
+                // item straight to it instead of going through a slot
+                if (!q_.poppers_.empty())
+                {
+                    auto *p = static_cast<pop_awaiter *>(q_.poppers_.pop_front());
+                    p->result_.emplace(std::move(item_));
+                    ok_ = true;
+                    lk.unlock();
+                    q_.sched_.post(p->handle);
+                    return false;
+                }
+                if (q_.count_ < Capacity)
+                {
+                    q_.put(std::move(item_));
+                    ok_ = true;
+                    return false;
+                }
+                this->handle = h;
+                q_.pushers_.push_back(this);
+                return true;
+            }
+
+            bool await_resume() const noexcept { return ok_; }
+
+        private:
+            friend class async_queue;
+            async_queue &q_;
+            T item_;
+            bool ok_ = false;
+        };
+
+    private:
+        // caller holds mtx_ and count_ < Capacity
+        void put(T &&item) noexcept
+        {
+            ::new (static_cast<void *>(slot(tail_))) T(std::move(item));
+            tail_ = (tail_ + 1) % Capacity;
+            count_++;
+        }
+
+        // caller holds mtx_ and count_ > 0
+        T take() noexcept
+        {
+            T *p = slot(head_);
+            T out(std::move(*p));
+            p->~T();
+            head_ = (head_ + 1) % Capacity;
+            count_--;
+            return out;
+        }
+
+        T *slot(std::size_t i) noexcept
+        {
+            return std::launder(reinterpret_cast<T *>(storage_[i].bytes));
+        }
+
+        void resume_all(waiter *w)
+        {
+            while (w)
+            {
+                // read next before posting: the frame may be gone right after
+                waiter *next = w->next;
+                sched_.post(w->handle);
+                w = next;
+            }
+        }
+
+        struct cell
+        {
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+
+        scheduler &sched_;
+        mutable std::mutex mtx_;
+        waiter_list poppers_;
+        waiter_list pushers_;
+        std::size_t head_ = 0;
+        std::size_t tail_ = 0;
+        std::size_t count_ = 0;
+        bool closed_ = false;
+        cell storage_[Capacity];
+    };
+} // namespace lab
+
+#endif
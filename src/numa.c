@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include "numa.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// One lab.c queue per node. Threads enqueue locally and dequeue locally
+// first, so the common case never touches another socket's memory.
+// Consumers that find every sub-queue empty sleep on the top-level
+// condition; producers only take the top-level lock when someone sleeps.
+
+#define SYS_NODE "/sys/devices/system/node"
+#define MAX_NODES 1024
+
+typedef struct numa_queue {
+    int nodes;                 // number of sub-queues
+    queue_t *sub;              // sub-queue per node index
+    int *node_of_cpu;          // cpu -> node index, -1 if unknown
+    int ncpus;
+
+    pthread_mutex_t mtx;       // guards sleeping consumers only
+    pthread_cond_t cond_items;
+    _Atomic int sleepers;
+    bool is_closed;
+} numa_queue;
+
+// parse a sysfs list like "0-3,8" calling fn for every number
+static int for_each_in_list(const char *path, void (*fn)(int, void *), void *arg) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int lo, hi;
+    char sep;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = '\n';
+        }
+        for (int i = lo; i <= hi; i++) fn(i, arg);
+        if (sep != ',') break;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void add_node(int node, void *arg) {
+    int *ids = arg;
+    if (ids[0] < MAX_NODES) ids[1 + ids[0]++] = node;
+}
+
+struct cpu_map {
+    int *node_of_cpu;
+    int ncpus;
+    int index;
+};
+
+static void map_cpu(int cpu, void *arg) {
+    struct cpu_map *m = arg;
+    if (cpu < m->ncpus) m->node_of_cpu[cpu] = m->index;
+}
+
+numa_queue_t numa_queue_init(int capacity) {
+    numa_queue_t q = calloc(1, sizeof(struct numa_queue));
+    if (!q) return NULL;
+
+    // ids[0] is the count, node ids follow
+    int *ids = calloc(MAX_NODES + 1, sizeof(int));
+    if (!ids) {
+        free(q);
+        return NULL;
+    }
+    if (for_each_in_list(SYS_NODE "/online", add_node, ids) != 0 || ids[0] == 0) {
+        // no NUMA information: behave as a single node
+        ids[0] = 1;
+        ids[1] = -1;
+    }
+
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    q->ncpus = ncpus > 0 ? (int)ncpus : 1;
+    q->node_of_cpu = malloc(sizeof(int) * q->ncpus);
+    q->sub = calloc(ids[0], sizeof(queue_t));
+    if (!q->node_of_cpu || !q->sub) goto fail;
+    for (int i = 0; i < q->ncpus; i++) q->node_of_cpu[i] = -1;
+
+    for (int i = 0; i < ids[0]; i++) {
+        q->sub[i] = queue_init_numa(capacity, ids[1 + i]);
+        if (!q->sub[i]) goto fail;
+        q->nodes++;
+
+        if (ids[1 + i] >= 0) {
+            char path[64];
+            struct cpu_map m = {q->node_of_cpu, q->ncpus, i};
+            snprintf(path, sizeof(path), SYS_NODE "/node%d/cpulist", ids[1 + i]);
+            for_each_in_list(path, map_cpu, &m);
+        }
+    }
+    free(ids);
+
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cond_items, NULL);
+    return q;
+
+fail:
+    for (int i = 0; i < q->nodes; i++) queue_destroy(q->sub[i]);
+    free(q->sub);
+    free(q->node_of_cpu);
+    free(ids);
+    free(q);
+    return NULL;
+}
+
+void numa_queue_destroy(numa_queue_t q) {
+    if (!q) return;
+    numa_queue_shutdown(q);
+    for (int i = 0; i < q->nodes; i++) queue_destroy(q->sub[i]);
+    pthread_mutex_destroy(&q->mtx);
+    pthread_cond_destroy(&q->cond_items);
+    free(q->sub);
+    free(q->node_of_cpu);
+    free(q);
+}
+
+// index of the sub-queue local to the calling thread
+static int local_index(numa_queue_t q) {
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= q->ncpus || q->node_of_cpu[cpu] < 0) return 0;
+    return q->node_of_cpu[cpu];
+}
+
+void numa_enqueue(numa_queue_t q, void *data) {
+    enqueue(q->sub[local_index(q)], data);
+
+    // Pairs with the sleepers++ in numa_dequeue: either the consumer's scan
+    // sees this item or we see it sleeping and wake it.
+    if (atomic_load(&q->sleepers) > 0) {
+        pthread_mutex_lock(&q->mtx);
+        pthread_cond_signal(&q->cond_items);
+        pthread_mutex_unlock(&q->mtx);
+    }
+}
+
+// local sub-queue first, then the other nodes in order
+static void *scan(numa_queue_t q, int local) {
+    for (int i = 0; i < q->nodes; i++) {
+        void *out = try_dequeue(q->sub[(local + i) % q->nodes]);
+        if (out) return out;
+    }
+    return NULL;
+}
+
+void *numa_dequeue(numa_queue_t q) {
+    int local = local_index(q);
+    void *out = scan(q, local);
+    if (out) return out;
+
+    pthread_mutex_lock(&q->mtx);
+    atomic_fetch_add(&q->sleepers, 1);
+    while (!(out = scan(q, local)) && !q->is_closed)
+        pthread_cond_wait(&q->cond_items, &q->mtx);
+    atomic_fetch_sub(&q->sleepers, 1);
+    pthread_mutex_unlock(&q->mtx);
+    return out;
+}
+
+void numa_queue_shutdown(numa_queue_t q) {
+    pthread_mutex_lock(&q->mtx);
+    q->is_closed = true;
+    for (int i = 0; i < q->nodes; i++) queue_shutdown(q->sub[i]);
+    pthread_cond_broadcast(&q->cond_items);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+int numa_queue_nodes(numa_queue_t q) {
+    return q->nodes;
+}
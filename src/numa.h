@@ -0,0 +1,69 @@
+#ifndef NUMA_H
+#define NUMA_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a hierarchical queue made of one
+     * sub-queue per NUMA node
+     */
+    typedef struct numa_queue *numa_queue_t;
+
+    /**
+     * @brief Initialize a hierarchical queue with one sub-queue per online
+     * NUMA node, each allocated on its own node. Items are not globally FIFO:
+     * order is kept per sub-queue only.
+     *
+     * @param capacity the maximum capacity of each sub-queue
+     * @return A fully initialized queue, or NULL on failure
+     */
+    numa_queue_t numa_queue_init(int capacity);
+
+    /**
+     * @brief Frees all sub-queues. No thread may still be using the queue.
+     *
+     * @param q a queue to free
+     */
+    void numa_queue_destroy(numa_queue_t q);
+
+    /**
+     * @brief Adds an element to the sub-queue of the caller's node. Blocks
+     * while that sub-queue is full.
+     *
+     * @param q the queue
+     * @param data the data to add
+     */
+    void numa_enqueue(numa_queue_t q, void *data);
+
+    /**
+     * @brief Removes an element, preferring the caller's node and only then
+     * taking work from other nodes. Blocks while every sub-queue is empty.
+     *
+     * @param q the queue
+     * @return the element, or NULL once the queue is shut down and drained
+     */
+    void *numa_dequeue(numa_queue_t q);
+
+    /**
+     * @brief Shuts down every sub-queue and wakes all waiting threads.
+     *
+     * @param q The queue
+     */
+    void numa_queue_shutdown(numa_queue_t q);
+
+    /**
+     * @brief Number of sub-queues, i.e. online NUMA nodes.
+     *
+     * @param q The queue
+     */
+    int numa_queue_nodes(numa_queue_t q);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "spill.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Values go into a write buffer and reach the file one full buffer at a
+// time; reads pull a buffer's worth back. The oldest values are in the
+// read buffer, then the file between rd_off and wr_off, then the write
+// buffer. When all of that drains the file is truncated, so it only ever
+// grows as large as the deepest backlog.
+
+#define SPILL_CHUNK 4096   // values per read or write, 32 KiB on 64-bit
+
+typedef struct spill {
+    int fd;
+    uintptr_t wbuf[SPILL_CHUNK];
+    int wstart, wlen;      // pending values are wbuf[wstart..wlen)
+    uintptr_t rbuf[SPILL_CHUNK];
+    int rpos, rlen;
+    off_t rd_off, wr_off;  // unread bytes of the file, always whole values
+    uint64_t count;
+    uint64_t lost;         // values given up to read errors, see spill_take_lost
+    spill_read_fn read_at;
+    queue_allocator_t alloc;
+} spill;
+
+spill_t spill_open(const char *dir, const queue_allocator_t *alloc) {
+    spill_t s = alloc->alloc(sizeof(spill), alloc->ctx);
+    if (!s) return NULL;
+    memset(s, 0, sizeof(spill));
+    s->alloc = *alloc;
+    s->read_at = pread;
+
+    s->fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+    if (s->fd < 0) {
+        // filesystems without O_TMPFILE: create, then unlink
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/spill-XXXXXX", dir);
+        s->fd = mkstemp(path);
+        if (s->fd >= 0) unlink(path);
+    }
+    if (s->fd < 0) {
+        alloc->free(s, sizeof(spill), alloc->ctx);
+        return NULL;
+    }
+    return s;
+}
+
+void spill_close(spill_t s) {
+    if (!s) return;
+    close(s->fd);
+    s->alloc.free(s, sizeof(spill), s->alloc.ctx);
+}
+
+// write out the buffered values
+static int flush(spill_t s) {
+    size_t bytes = sizeof(uintptr_t) * (s->wlen - s->wstart);
+    const char *p = (const char *)&s->wbuf[s->wstart];
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = pwrite(s->fd, p + done, bytes - done, s->wr_off + done);
+        if (n <= 0) return -1;
+        done += n;
+    }
+    s->wr_off += bytes;
+    s->wstart = s->wlen = 0;
+    return 0;
+}
+
+int spill_push(spill_t s, void *item) {
+    if (s->wlen == SPILL_CHUNK && flush(s) != 0) return -1;
+    s->wbuf[s->wlen++] = (uintptr_t)item;
+    s->count++;
+    return 0;
+}
+
+void spill_set_reader(spill_t s, spill_read_fn fn) {
+    s->read_at = fn ? fn : pread;
+}
+
+uint64_t spill_take_lost(spill_t s) {
+    uint64_t n = s->lost;
+    s->lost = 0;
+    return n;
+}
+
+// start the file over at offset 0 and give the blocks back
+static void reset_file(spill_t s) {
+    s->rd_off = s->wr_off = 0;
+    // failing to shrink only costs disk space until close
+    int rc = ftruncate(s->fd, 0);
+    (void)rc;
+}
+
+// fill rbuf with the next values from the file, retrying short reads so
+// rd_off only ever moves by whole values
+static int fill(spill_t s) {
+    size_t want = sizeof(s->rbuf);
+    if ((off_t)want > s->wr_off - s->rd_off) want = s->wr_off - s->rd_off;
+    size_t got = 0;
+    while (got < want) {
+        ssize_t n = s->read_at(s->fd, (char *)s->rbuf + got, want - got, s->rd_off + got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;  // an error, or the file is shorter than we wrote
+        got += n;
+    }
+    s->rd_off += want;
+    s->rpos = 0;
+    s->rlen = want / sizeof(uintptr_t);
+    if (s->rd_off == s->wr_off) reset_file(s);
+    return 0;
+}
+
+bool spill_pop(spill_t s, void **item) {
+    if (s->rpos == s->rlen && s->rd_off < s->wr_off && fill(s) != 0) {
+        // what is still in the file cannot be read back: drop it and go on
+        // with the write buffer, so count never claims values pop cannot give
+        uint64_t n = (s->wr_off - s->rd_off) / sizeof(uintptr_t);
+        s->count -= n;
+        s->lost += n;
+        s->rpos = s->rlen = 0;
+        reset_file(s);
+    }
+
+    if (s->rpos < s->rlen) {
+        *item = (void *)s->rbuf[s->rpos++];
+    } else if (s->wstart < s->wlen) {
+        *item = (void *)s->wbuf[s->wstart++];
+        if (s->wstart == s->wlen) s->wstart = s->wlen = 0;
+    } else {
+        return false;
+    }
+    s->count--;
+    return true;
+}
+
+uint64_t spill_count(spill_t s) {
+    return s->count;
+}
@@ -0,0 +1,76 @@
+#ifndef SPILL_H
+#define SPILL_H
+#include "lab.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type for a FIFO of pointer-sized values kept in an
+     * unlinked temporary file. Used by queues with QUEUE_SPILL.
+     */
+    typedef struct spill *spill_t;
+
+    /**
+     * @brief Create an anonymous spill file in @p dir.
+     *
+     * @param dir directory for the file, which is unlinked right away
+     * @param alloc where the spill and its buffers come from
+     * @return the spill, or NULL on failure
+     */
+    spill_t spill_open(const char *dir, const queue_allocator_t *alloc);
+
+    /**
+     * @brief Close the file and free the buffers.
+     *
+     * @param s the spill, may be NULL
+     */
+    void spill_close(spill_t s);
+
+    /**
+     * @brief Append @p item. Values are buffered and written in large
+     * sequential chunks.
+     *
+     * @return 0 on success, -1 if the file could not be written
+     */
+    int spill_push(spill_t s, void *item);
+
+    /**
+     * @brief Remove the oldest value.
+     *
+     * @return false if the spill is empty or could not be read
+     */
+    bool spill_pop(spill_t s, void **item);
+
+    /**
+     * @brief Number of values held.
+     */
+    uint64_t spill_count(spill_t s);
+
+    /**
+     * @brief Number of values dropped because the file could not be read
+     * back since the last call. A failed read gives up everything still in
+     * the file, so spill_count() never counts values spill_pop cannot return.
+     */
+    uint64_t spill_take_lost(spill_t s);
+
+    /**
+     * @brief pread(2) stand-in, for tests that inject short or failed reads.
+     */
+    typedef ssize_t (*spill_read_fn)(int fd, void *buf, size_t n, off_t off);
+
+    /**
+     * @brief Replace the read function; NULL restores pread.
+     */
+    void spill_set_reader(spill_t s, spill_read_fn fn);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include "wal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Log layout: DIR/<first seq>.log segments holding records
+//
+//   u32 len | u32 crc32(seq, payload) | u64 seq | payload
+//
+// and DIR/checkpoint holding the first sequence number not yet consumed.
+//
+// Enqueuers append their record to a shared batch buffer. Whoever finds no
+// flush in progress becomes the leader: it takes the batch, writes it with
+// one write() and one fdatasync() outside the lock, then publishes the
+// records to consumers and wakes the followers whose records it carried.
+// Records that arrive during a flush form the next batch, so the number of
+// syncs drops as concurrency rises.
+
+#define DEFAULT_SEGMENT_BYTES (64u << 20)
+#define DEFAULT_CHECKPOINT_EVERY 1024
+#define HEADER_BYTES 16
+
+typedef struct rec {
+    struct rec *next;
+    uint64_t seq;
+    size_t len;
+    void *data;
+} rec;
+
+typedef struct {
+    char *bytes;
+    size_t len;
+    size_t cap;
+} buffer;
+
+typedef struct wal_queue {
+    char *dir;
+    size_t segment_bytes;
+    int checkpoint_every;
+
+    int fd;                    // current segment, -1 before the first write
+    size_t seg_size;
+    uint64_t *segs;            // first seq of each live segment, oldest first
+    int nsegs;
+    int segs_cap;
+
+    uint64_t next_seq;         // seq of the next enqueue
+    uint64_t durable_seq;      // everything below is on disk
+    uint64_t consumed;         // everything below has been dequeued
+    uint64_t checkpointed;     // value in the checkpoint file
+    int since_checkpoint;
+
+    buffer batch;              // records waiting for the next flush
+    buffer spare;
+    rec *batch_head, *batch_tail;
+    bool flushing;
+    int error;                 // sticky errno from a failed flush
+
+    rec *head, *tail;          // durable records not yet dequeued
+    bool is_closed;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond_durable;
+    pthread_cond_t cond_not_empty;
+    pthread_mutex_t checkpoint_mtx; // one checkpoint writer at a time
+} wal_queue;
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const void *data, size_t len) {
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t record_crc(uint64_t seq, const void *data, size_t len) {
+    return crc32(crc32(0, &seq, sizeof(seq)), data, len);
+}
+
+static void segment_path(wal_queue_t q, uint64_t first, char *out, size_t n) {
+    snprintf(out, n, "%s/%020" PRIu64 ".log", q->dir, first);
+}
+
+// make a new or renamed directory entry durable
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static int push_segment(wal_queue_t q, uint64_t first) {
+    if (q->nsegs == q->segs_cap) {
+        int cap = q->segs_cap ? q->segs_cap * 2 : 16;
+        uint64_t *segs = realloc(q->segs, sizeof(uint64_t) * cap);
+        if (!segs) return -1;
+        q->segs = segs;
+        q->segs_cap = cap;
+    }
+    q->segs[q->nsegs++] = first;
+    return 0;
+}
+
+static int buffer_append(buffer *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len) cap *= 2;
+        char *bytes = realloc(b->bytes, cap);
+        if (!bytes) return -1;
+        b->bytes = bytes;
+        b->cap = cap;
+    }
+    memcpy(b->bytes + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static void free_recs(rec *r) {
+    while (r) {
+        rec *next = r->next;
+        free(r->data);
+        free(r);
+        r = next;
+    }
+}
+
+// ---- recovery ----
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t read_checkpoint(wal_queue_t q) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/checkpoint", q->dir);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    uint64_t seq = 0;
+    if (fscanf(f, "%" SCNu64, &seq) != 1) seq = 0;
+    fclose(f);
+    return seq;
+}
+
+// queue every record with seq >= from; returns the valid length of the
+// file, or -1 if a record in the middle of the log is bad
+static long replay_segment(wal_queue_t q, uint64_t first, uint64_t from, bool last) {
+    char path[4096];
+    segment_path(q, first, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    long valid = 0;
+    uint64_t expect = first;
+    for (;;) {
+        uint32_t hdr[2];
+        uint64_t seq;
+        if (fread(hdr, sizeof(hdr), 1, f) != 1 || fread(&seq, sizeof(seq), 1, f) != 1) break;
+        // a torn length may claim more than the file holds: don't allocate it
+        if (hdr[0] > st.st_size - valid - HEADER_BYTES) break;
+        void *data = malloc(hdr[0] ? hdr[0] : 1);
+        if (!data) break;
+        if (fread(data, 1, hdr[0], f) != hdr[0] || seq != expect ||
+            record_crc(seq, data, hdr[0]) != hdr[1]) {
+            free(data);
+            break;
+        }
+        valid += HEADER_BYTES + hdr[0];
+        expect++;
+
+        if (seq < from) {
+            free(data);
+            continue;
+        }
+        rec *r = malloc(sizeof(rec));
+        if (!r) {
+            free(data);
+            break;
+        }
+        *r = (rec){NULL, seq, hdr[0], data};
+        if (q->tail) q->tail->next = r;
+        else q->head = r;
+        q->tail = r;
+    }
+    bool at_end = feof(f);
+    fclose(f);
+
+    // a torn record can only be the last write before a crash
+    if (!at_end && !last) return -1;
+    if (expect > q->next_seq) q->next_seq = expect;
+    return valid;
+}
+
+static int recover(wal_queue_t q) {
+    uint64_t from = read_checkpoint(q);
+    q->next_seq = from;
+
+    DIR *d = opendir(q->dir);
+    if (!d) return -1;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        uint64_t first;
+        char tail;
+        if (sscanf(e->d_name, "%" SCNu64 ".lo%c", &first, &tail) == 2 && tail == 'g' &&
+            push_segment(q, first) != 0) {
+            closedir(d);
+            return -1;
+        }
+    }
+    closedir(d);
+    qsort(q->segs, q->nsegs, sizeof(uint64_t), cmp_u64);
+
+    // skip segments that hold only consumed records without reading them
+    int skip = 0;
+    while (skip + 1 < q->nsegs && q->segs[skip + 1] <= from) skip++;
+    for (int i = 0; i < skip; i++) {
+        char path[4096];
+        segment_path(q, q->segs[i], path, sizeof(path));
+        unlink(path);
+    }
+    memmove(q->segs, q->segs + skip, sizeof(uint64_t) * (q->nsegs - skip));
+    q->nsegs -= skip;
+
+    long valid = 0;
+    for (int i = 0; i < q->nsegs; i++) {
+        valid = replay_segment(q, q->segs[i], from, i == q->nsegs - 1);
+        if (valid < 0) return -1;
+    }
+
+    if (q->nsegs > 0) {
+        char path[4096];
+        segment_path(q, q->segs[q->nsegs - 1], path, sizeof(path));
+        q->fd = open(path, O_WRONLY);
+        if (q->fd < 0 || ftruncate(q->fd, valid) != 0 || lseek(q->fd, valid, SEEK_SET) < 0) return -1;
+        q->seg_size = valid;
+    }
+    q->durable_seq = q->next_seq;
+    q->consumed = q->head ? q->head->seq : q->next_seq;
+    q->checkpointed = from;
+    return 0;
+}
+
+wal_queue_t wal_queue_open(const char *dir, const struct wal_options *opts) {
+    pthread_once(&crc_once, crc_init);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return NULL;
+
+    wal_queue_t q = calloc(1, sizeof(struct wal_queue));
+    if (!q) return NULL;
+    q->dir = strdup(dir);
+    q->fd = -1;
+    q->segment_bytes = opts && opts->segment_bytes ? opts->segment_bytes : DEFAULT_SEGMENT_BYTES;
+    q->checkpoint_every = opts && opts->checkpoint_every > 0 ? opts->checkpoint_every
+                                                             : DEFAULT_CHECKPOINT_EVERY;
+    if (!q->dir || recover(q) != 0) {
+        if (q->fd >= 0) close(q->fd);
+        free_recs(q->head);
+        free(q->segs);
+        free(q->dir);
+        free(q);
+        return NULL;
+    }
+
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_mutex_init(&q->checkpoint_mtx, NULL);
+    pthread_cond_init(&q->cond_durable, NULL);
+    pthread_cond_init(&q->cond_not_empty, NULL);
+    return q;
+}
+
+void wal_queue_close(wal_queue_t q) {
+    if (!q) return;
+    wal_queue_shutdown(q);
+    wal_checkpoint(q);
+    if (q->fd >= 0) close(q->fd);
+    free_recs(q->head);
+    free_recs(q->batch_head);
+    free(q->batch.bytes);
+    free(q->spare.bytes);
+    free(q->segs);
+    free(q->dir);
+    pthread_mutex_destroy(&q->mtx);
+    pthread_mutex_destroy(&q->checkpoint_mtx);
+    pthread_cond_destroy(&q->cond_durable);
+    pthread_cond_destroy(&q->cond_not_empty);
+    free(q);
+}
+
+// ---- group commit ----
+
+// write the batch as leader; called and returns with mtx held
+static void flush(wal_queue_t q) {
+    q->flushing = true;
+    buffer out = q->batch;
+    q->batch = q->spare;
+    q->batch.len = 0;
+    rec *first = q->batch_head, *last = q->batch_tail;
+    q->batch_head = q->batch_tail = NULL;
+    uint64_t end = q->next_seq;
+    pthread_mutex_unlock(&q->mtx);
+
+    // only the leader touches fd and seg_size, so no lock is needed here
+    int err = 0;
+    bool rotated = false;
+    if (q->fd < 0 || q->seg_size >= q->segment_bytes) {
+        char path[4096];
+        segment_path(q, first->seq, path, sizeof(path));
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || sync_dir(q->dir) != 0) {
+            err = errno;
+            if (fd >= 0) close(fd);
+        } else {
+            if (q->fd >= 0) close(q->fd);
+            q->fd = fd;
+            q->seg_size = 0;
+            rotated = true;
+        }
+    }
+    for (size_t off = 0; !err && off < out.len;) {
+        ssize_t n = write(q->fd, out.bytes + off, out.len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) err = errno;
+        else off += n;
+    }
+    if (!err && fdatasync(q->fd) != 0) err = errno;
+    if (!err) q->seg_size += out.len;
+
+    pthread_mutex_lock(&q->mtx);
+    if (rotated && push_segment(q, first->seq) != 0) err = ENOMEM;
+    out.len = 0;
+    q->spare = out;
+    q->flushing = false;
+    if (err) {
+        q->error = err;
+        free_recs(first);
+    } else {
+        q->durable_seq = end;
+        if (q->tail) q->tail->next = first;
+        else q->head = first;
+        q->tail = last;
+        pthread_cond_broadcast(&q->cond_not_empty);
+    }
+    pthread_cond_broadcast(&q->cond_durable);
+}
+
+int wal_enqueue(wal_queue_t q, const void *data, size_t len) {
+    if (len > UINT32_MAX) return -1;
+    rec *r = malloc(sizeof(rec));
+    void *copy = malloc(len ? len : 1);
+    if (!r || !copy) {
+        free(r);
+        free(copy);
+        return -1;
+    }
+    memcpy(copy, data, len);
+
+    pthread_mutex_lock(&q->mtx);
+    if (q->is_closed || q->error) {
+        pthread_mutex_unlock(&q->mtx);
+        free(r);
+        free(copy);
+        return -1;
+    }
+
+    uint64_t seq = q->next_seq;
+    uint32_t hdr[2] = {(uint32_t)len, record_crc(seq, data, len)};
+    size_t mark = q->batch.len;
+    if (buffer_append(&q->batch, hdr, sizeof(hdr)) != 0 ||
+        buffer_append(&q->batch, &seq, sizeof(seq)) != 0 ||
+        buffer_append(&q->batch, data, len) != 0) {
+        // drop any partial record so the batch stays parseable
+        q->batch.len = mark;
+        pthread_mutex_unlock(&q->mtx);
+        free(r);
+        free(copy);
+        return -1;
+    }
+    q->next_seq++;
+    *r = (rec){NULL, seq, len, copy};
+    if (q->batch_tail) q->batch_tail->next = r;
+    else q->batch_head = r;
+    q->batch_tail = r;
+
+    // lead a flush when none is running, otherwise ride along with the next
+    while (q->durable_seq <= seq && !q->error) {
+        if (!q->flushing) flush(q);
+        else pthread_cond_wait(&q->cond_durable, &q->mtx);
+    }
+    int rc = q->durable_seq > seq ? 0 : -1;
+    pthread_mutex_unlock(&q->mtx);
+    return rc;
+}
+
+void *wal_dequeue(wal_queue_t q, size_t *len) {
+    pthread_mutex_lock(&q->mtx);
+    while (!q->head) {
+        if (q->is_closed) {
+            pthread_mutex_unlock(&q->mtx);
+            return NULL;
+        }
+        pthread_cond_wait(&q->cond_not_empty, &q->mtx);
+    }
+
+    rec *r = q->head;
+    q->head = r->next;
+    if (!q->head) q->tail = NULL;
+    q->consumed = r->seq + 1;
+    bool checkpoint = ++q->since_checkpoint >= q->checkpoint_every;
+    pthread_mutex_unlock(&q->mtx);
+
+    if (checkpoint) wal_checkpoint(q);
+    void *out = r->data;
+    if (len) *len = r->len;
+    free(r);
+    return out;
+}
+
+int wal_checkpoint(wal_queue_t q) {
+    pthread_mutex_lock(&q->checkpoint_mtx);
+    pthread_mutex_lock(&q->mtx);
+    uint64_t upto = q->consumed;
+    q->since_checkpoint = 0;
+    pthread_mutex_unlock(&q->mtx);
+    if (upto == q->checkpointed) {
+        pthread_mutex_unlock(&q->checkpoint_mtx);
+        return 0;
+    }
+
+    // write-then-rename so a crash leaves the old or the new checkpoint
+    char tmp[4096], path[4096];
+    snprintf(tmp, sizeof(tmp), "%s/checkpoint.tmp", q->dir);
+    snprintf(path, sizeof(path), "%s/checkpoint", q->dir);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        pthread_mutex_unlock(&q->checkpoint_mtx);
+        return -1;
+    }
+    char text[32];
+    int n = snprintf(text, sizeof(text), "%" PRIu64 "\n", upto);
+    int rc = write(fd, text, n) == n && fdatasync(fd) == 0 ? 0 : -1;
+    close(fd);
+    if (rc == 0 && (rename(tmp, path) != 0 || sync_dir(q->dir) != 0)) rc = -1;
+    if (rc != 0) {
+        pthread_mutex_unlock(&q->checkpoint_mtx);
+        return -1;
+    }
+
+    // segments whose successor starts at or below upto are fully consumed;
+    // the newest segment is never dropped, the leader may be writing it
+    pthread_mutex_lock(&q->mtx);
+    q->checkpointed = upto;
+    int drop = 0;
+    while (drop + 1 < q->nsegs && q->segs[drop + 1] <= upto) drop++;
+    uint64_t dropped[drop > 0 ? drop : 1];
+    memcpy(dropped, q->segs, sizeof(uint64_t) * drop);
+    memmove(q->segs, q->segs + drop, sizeof(uint64_t) * (q->nsegs - drop));
+    q->nsegs -= drop;
+    pthread_mutex_unlock(&q->mtx);
+
+    for (int i = 0; i < drop; i++) {
+        segment_path(q, dropped[i], path, sizeof(path));
+        unlink(path);
+    }
+    pthread_mutex_unlock(&q->checkpoint_mtx);
+    return 0;
+}
+
+void wal_queue_shutdown(wal_queue_t q) {
+    pthread_mutex_lock(&q->mtx);
+    q->is_closed = true;
+    pthread_cond_broadcast(&q->cond_not_empty);
+    pthread_mutex_unlock(&q->mtx);
+}
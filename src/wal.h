@@ -0,0 +1,90 @@
+#ifndef WAL_H
+#define WAL_H
+#include <stddef.h>
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a queue whose items are kept in a
+     * write-ahead log on disk
+     */
+    typedef struct wal_queue *wal_queue_t;
+
+    /**
+     * @brief tuning for wal_queue_open(); zero fields take the default
+     */
+    struct wal_options
+    {
+        size_t segment_bytes;  // start a new log file past this size, default 64 MiB
+        int checkpoint_every;  // dequeues between automatic checkpoints, default 1024
+    };
+
+    /**
+     * @brief Open or create a durable queue in directory @p dir. Any items
+     * left in the log after the last checkpoint are queued again, in order.
+     * Only segments that still hold unconsumed items are read, so recovery
+     * time follows the unconsumed tail, not the history.
+     *
+     * @param dir directory for the log segments and checkpoint, created if missing
+     * @param opts tuning, or NULL for the defaults
+     * @return the queue, or NULL if the log could not be opened or is corrupt
+     */
+    wal_queue_t wal_queue_open(const char *dir, const struct wal_options *opts);
+
+    /**
+     * @brief Write a final checkpoint and free the queue. No thread may
+     * still be using it.
+     *
+     * @param q a queue to close
+     */
+    void wal_queue_close(wal_queue_t q);
+
+    /**
+     * @brief Append a copy of @p len bytes at @p data to the log and queue
+     * it. Returns once the record is on disk; concurrent callers share one
+     * fdatasync per batch (group commit).
+     *
+     * @param q the queue
+     * @param data the payload
+     * @param len payload size in bytes
+     * @return 0 once durable, -1 if shut down or the write failed
+     */
+    int wal_enqueue(wal_queue_t q, const void *data, size_t len);
+
+    /**
+     * @brief Removes the oldest durable item, blocking while there is none.
+     * Delivery is at least once: items dequeued after the last checkpoint
+     * come back after a crash.
+     *
+     * @param q the queue
+     * @param len set to the payload size
+     * @return a malloc'd copy of the payload for the caller to free, or
+     * NULL once the queue is shut down and drained
+     */
+    void *wal_dequeue(wal_queue_t q, size_t *len);
+
+    /**
+     * @brief Record durably how far consumers have got and delete log
+     * segments that hold only consumed items.
+     *
+     * @param q the queue
+     * @return 0 on success, -1 on I/O errors
+     */
+    int wal_checkpoint(wal_queue_t q);
+
+    /**
+     * @brief Set the shutdown flag and wake all waiting threads.
+     *
+     * @param q The queue
+     */
+    void wal_queue_shutdown(wal_queue_t q);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include "wheel.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Hashed hierarchical timing wheel (Varghese & Lauck). Level l has 64
+// slots of 64^l ticks each. A timer goes into the lowest level whose span
+// covers its distance from now; when a level-0 rotation completes, the
+// next level-1 slot is cascaded down, and so on up. Insertion, expiry and
+// each cascade step are O(1) per timer. The timer thread sleeps until the
+// next non-empty slot, so idle or far-off timers cost no wakeups.
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4               // 64^4 ms is about 4.6 hours
+#define NODES_PER_CHUNK 1024
+
+typedef struct tnode {
+    struct tnode *next;
+    void *item;
+    uint64_t when;                   // deadline in ticks
+} tnode;
+
+typedef struct {
+    tnode *head;
+    tnode *tail;
+} slot_list;
+
+typedef struct chunk {
+    struct chunk *next;
+    tnode nodes[NODES_PER_CHUNK];
+} chunk;
+
+typedef struct wheel {
+    queue_t q;
+    slot_list slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t now;                    // last tick processed
+    uint64_t wake;                   // tick the timer thread sleeps until
+    uint64_t pending;
+    tnode *free_nodes;               // nodes are pooled, never freed one by one
+    chunk *chunks;
+    bool stopping;
+    queue_allocator_t alloc;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;             // uses CLOCK_MONOTONIC
+    pthread_t thread;
+} wheel;
+
+static uint64_t to_tick(uint64_t ns) {
+    return (ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+static void list_append(slot_list *l, tnode *n) {
+    n->next = NULL;
+    if (l->tail) l->tail->next = n;
+    else l->head = n;
+    l->tail = n;
+}
+
+// link n into its slot, or onto due if its deadline already passed
+static void place(wheel_t w, tnode *n, slot_list *due) {
+    if (n->when <= w->now) {
+        list_append(due, n);
+        return;
+    }
+    uint64_t delta = n->when - w->now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >> (WHEEL_BITS * (level + 1)))
+        level++;
+    // beyond the top level: park in its farthest slot, re-placed on cascade
+    uint64_t when = n->when;
+    if (delta >> (WHEEL_BITS * WHEEL_LEVELS))
+        when = w->now + ((uint64_t)WHEEL_MASK << (WHEEL_BITS * (WHEEL_LEVELS - 1)));
+    list_append(&w->slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK], n);
+}
+
+// advance one tick, moving everything that became due onto due
+static void step(wheel_t w, slot_list *due) {
+    w->now++;
+    for (int level = WHEEL_LEVELS - 1; level > 0; level--) {
+        if (w->now & ((1ull << (WHEEL_BITS * level)) - 1)) continue;
+        slot_list *s = &w->slots[level][(w->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+        tnode *n = s->head;
+        s->head = s->tail = NULL;
+        while (n) {
+            tnode *next = n->next;
+            place(w, n, due);
+            n = next;
+        }
+    }
+    slot_list *s = &w->slots[0][w->now & WHEEL_MASK];
+    while (s->head) {
+        tnode *n = s->head;
+        s->head = n->next;
+        list_append(due, n);
+    }
+    s->tail = NULL;
+}
+
+// earliest tick at which a non-empty slot is processed, UINT64_MAX if none
+static uint64_t next_event(wheel_t w) {
+    uint64_t best = UINT64_MAX;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = WHEEL_BITS * level;
+        uint64_t base = w->now >> shift;
+        for (uint64_t k = 1; k <= WHEEL_SLOTS; k++) {
+            if (w->slots[level][(base + k) & WHEEL_MASK].head) {
+                uint64_t t = (base + k) << shift;
+                if (t < best) best = t;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+static void *timer_thread(void *arg) {
+    wheel_t w = arg;
+    pthread_mutex_lock(&w->mtx);
+    while (!w->stopping) {
+        uint64_t target = queue_now_ns() / WHEEL_TICK_NS;
+        slot_list due = {NULL, NULL};
+
+        // jump over runs of empty slots instead of stepping through them
+        while (w->pending && w->now < target) {
+            uint64_t next = next_event(w);
+            if (next > target) break;
+            w->now = next - 1;
+            step(w, &due);
+        }
+        if (w->now < target) w->now = target;
+
+        if (due.head) {
+            // release outside the lock: enqueue may block on a full queue
+            pthread_mutex_unlock(&w->mtx);
+            uint64_t released = 0;
+            for (tnode *n = due.head; n; n = n->next, released++)
+                enqueue(w->q, n->item);
+            pthread_mutex_lock(&w->mtx);
+            due.tail->next = w->free_nodes;
+            w->free_nodes = due.head;
+            w->pending -= released;
+            continue;
+        }
+
+        w->wake = w->pending ? next_event(w) : UINT64_MAX;
+        if (w->wake == UINT64_MAX) {
+            pthread_cond_wait(&w->cond, &w->mtx);
+        } else {
+            uint64_t ns = w->wake * WHEEL_TICK_NS;
+            struct timespec ts = {(time_t)(ns / 1000000000u), (long)(ns % 1000000000u)};
+            pthread_cond_timedwait(&w->cond, &w->mtx, &ts);
+        }
+        w->wake = 0;
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return NULL;
+}
+
+wheel_t wheel_create(queue_t q, const queue_allocator_t *alloc) {
+    wheel_t w = alloc->alloc(sizeof(wheel), alloc->ctx);
+    if (!w) return NULL;
+    memset(w, 0, sizeof(wheel));
+    w->alloc = *alloc;
+    w->q = q;
+    w->now = queue_now_ns() / WHEEL_TICK_NS;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&w->mtx, NULL);
+
+    if (pthread_create(&w->thread, NULL, timer_thread, w) != 0) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->mtx);
+        alloc->free(w, sizeof(wheel), alloc->ctx);
+        return NULL;
+    }
+    return w;
+}
+
+int wheel_add(wheel_t w, void *item, uint64_t when_ns) {
+    pthread_mutex_lock(&w->mtx);
+    if (!w->free_nodes) {
+        chunk *c = w->alloc.alloc(sizeof(chunk), w->alloc.ctx);
+        if (!c) {
+            pthread_mutex_unlock(&w->mtx);
+            return -1;
+        }
+        c->next = w->chunks;
+        w->chunks = c;
+        for (int i = 0; i < NODES_PER_CHUNK; i++) {
+            c->nodes[i].next = w->free_nodes;
+            w->free_nodes = &c->nodes[i];
+        }
+    }
+    tnode *n = w->free_nodes;
+    w->free_nodes = n->next;
+    n->item = item;
+    n->when = to_tick(when_ns);
+    // never file into the tick being processed; the thread has moved past it
+    if (n->when <= w->now) n->when = w->now + 1;
+
+    slot_list due = {NULL, NULL};
+    place(w, n, &due);
+    w->pending++;
+
+    // wake the thread only if it sleeps past the new deadline
+    if (w->wake == UINT64_MAX || n->when < w->wake)
+        pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mtx);
+    return 0;
+}
+
+void wheel_destroy(wheel_t w) {
+    if (!w) return;
+    pthread_mutex_lock(&w->mtx);
+    w->stopping = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mtx);
+    pthread_join(w->thread, NULL);
+
+    while (w->chunks) {
+        chunk *c = w->chunks;
+        w->chunks = c->next;
+        w->alloc.free(c, sizeof(chunk), w->alloc.ctx);
+    }
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->mtx);
+    w->alloc.free(w, sizeof(wheel), w->alloc.ctx);
+}
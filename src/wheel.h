@@ -0,0 +1,54 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type for a hierarchical timing wheel that releases
+     * items into a queue when their deadline passes. Used by enqueue_at().
+     */
+    typedef struct wheel *wheel_t;
+
+    /**
+     * @brief resolution of the wheel; deadlines are rounded up to a tick
+     */
+#define WHEEL_TICK_NS 1000000ull
+
+    /**
+     * @brief Create a wheel and its timer thread. Due items are passed to
+     * enqueue() on @p q, so a full blocking queue holds back later ones.
+     *
+     * @param q the queue to release items into
+     * @param alloc where the wheel and its node chunks come from
+     * @return the wheel, or NULL on failure
+     */
+    wheel_t wheel_create(queue_t q, const queue_allocator_t *alloc);
+
+    /**
+     * @brief Schedule @p item for @p when_ns on the queue_now_ns() clock.
+     * O(1): the item is linked into one slot and never sorted.
+     *
+     * @param w the wheel
+     * @param item the item to release
+     * @param when_ns the deadline
+     * @return 0 on success, -1 if out of memory
+     */
+    int wheel_add(wheel_t w, void *item, uint64_t when_ns);
+
+    /**
+     * @brief Stop the timer thread and free the wheel. Items still pending
+     * are dropped without being released.
+     *
+     * @param w the wheel, may be NULL
+     */
+    void wheel_destroy(wheel_t w);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
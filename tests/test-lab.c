@@ -1,5 +1,18 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "harness/unity.h"
 #include "../src/lab.h"
+#include "../src/coalesce.h"
+#include "../src/keyed.h"
+#include "../src/numa.h"
+#include "../src/spill.h"
+#include "../src/wal.h"
 
 // NOTE: Due to the multi-threaded nature of this project. Unit testing for this
 // project is limited. I have provided you with a command line tester in
@@ -113,6 +126,600 @@ void test_fill_destroy() {
   queue_destroy(q);
 }
 
+void test_stats_counts() {
+  queue_t q = queue_init(4);
+  int a = 1, b = 2;
+  enqueue(q, &a);
+  enqueue(q, &b);
+  dequeue(q);
+  queue_stats_t st;
+  queue_stats(q, &st);
+#ifndef LAB_NO_STATS
+  TEST_ASSERT_EQUAL_UINT64(2, st.enqueued);
+  TEST_ASSERT_EQUAL_UINT64(1, st.dequeued);
+  TEST_ASSERT_EQUAL_UINT64(0, st.enqueue_blocked);
+  TEST_ASSERT_EQUAL_UINT64(0, st.dequeue_blocked);
+  uint64_t samples = 0;
+  for (int i = 0; i < QUEUE_OCCUPANCY_BUCKETS; i++) samples += st.occupancy[i];
+  TEST_ASSERT_EQUAL_UINT64(3, samples);
+  // 2 of 4 slots used after the second enqueue
+  TEST_ASSERT_EQUAL_UINT64(1, st.occupancy[2 * QUEUE_OCCUPANCY_BUCKETS / 5]);
+#else
+  TEST_ASSERT_EQUAL_UINT64(0, st.enqueued);
+#endif
+  queue_destroy(q);
+}
+
+void test_batch_roundtrip() {
+  queue_t q = queue_init(4);
+  int v[3] = {1, 2, 3};
+  void *in[3] = {&v[0], &v[1], &v[2]};
+  void *out[8] = {0};
+  TEST_ASSERT_EQUAL_INT(3, enqueue_batch(q, in, 3));
+  TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 2));
+  TEST_ASSERT_EQUAL_PTR(&v[0], out[0]);
+  TEST_ASSERT_EQUAL_PTR(&v[1], out[1]);
+  enqueue(q, &v[0]);
+  TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 8));
+  TEST_ASSERT_EQUAL_PTR(&v[2], out[0]);
+  TEST_ASSERT_EQUAL_PTR(&v[0], out[1]);
+  queue_shutdown(q);
+  TEST_ASSERT_EQUAL_INT(0, dequeue_batch(q, out, 8));
+  TEST_ASSERT_EQUAL_INT(0, enqueue_batch(q, in, 3));
+  queue_destroy(q);
+}
+
+void test_numa_node_queue() {
+  queue_t q = queue_init_numa(2, 0);
+  TEST_ASSERT_TRUE(q != NULL);
+  int a = 1, b = 2, c = 3;
+  enqueue(q, &a);
+  enqueue(q, &b);
+  TEST_ASSERT_EQUAL_PTR(&a, dequeue(q));
+  enqueue(q, &c);
+  TEST_ASSERT_EQUAL_PTR(&b, dequeue(q));
+  TEST_ASSERT_EQUAL_PTR(&c, try_dequeue(q));
+  TEST_ASSERT_NULL(try_dequeue(q));
+  queue_destroy(q);
+}
+
+void test_numa_hierarchical_drain() {
+  numa_queue_t q = numa_queue_init(4);
+  TEST_ASSERT_TRUE(q != NULL);
+  TEST_ASSERT_TRUE(numa_queue_nodes(q) >= 1);
+  int a = 1, b = 2;
+  numa_enqueue(q, &a);
+  numa_enqueue(q, &b);
+  TEST_ASSERT_EQUAL_PTR(&a, numa_dequeue(q));
+  numa_queue_shutdown(q);
+  TEST_ASSERT_EQUAL_PTR(&b, numa_dequeue(q));
+  TEST_ASSERT_NULL(numa_dequeue(q));
+  numa_queue_destroy(q);
+}
+
+static void count_evicted(void *item, void *ctx) {
+  (void)item;
+  (*(int *)ctx)++;
+}
+
+void test_overflow_reject_and_evict() {
+  int v[4] = {1, 2, 3, 4};
+  queue_t q = queue_init(2);
+  TEST_ASSERT_EQUAL_INT(0, queue_set_overflow(q, QUEUE_REJECT_NEW, NULL, NULL));
+  TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_status(q, &v[0]));
+  TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_status(q, &v[1]));
+  TEST_ASSERT_EQUAL_INT(QUEUE_REJECTED, enqueue_status(q, &v[2]));
+  TEST_ASSERT_EQUAL_PTR(&v[0], dequeue(q));
+  TEST_ASSERT_EQUAL_PTR(&v[1], dequeue(q));
+  queue_destroy(q);
+
+  int evicted = 0;
+  q = queue_init(2);
+  TEST_ASSERT_EQUAL_INT(0, queue_set_overflow(q, QUEUE_EVICT_OLDEST, count_evicted, &evicted));
+  void *in[4] = {&v[0], &v[1], &v[2], &v[3]};
+  TEST_ASSERT_EQUAL_INT(4, enqueue_batch(q, in, 4));
+  TEST_ASSERT_EQUAL_INT(2, evicted);
+  TEST_ASSERT_EQUAL_PTR(&v[2], dequeue(q));
+  TEST_ASSERT_EQUAL_PTR(&v[3], dequeue(q));
+  queue_stats_t st;
+  queue_stats(q, &st);
+#ifndef LAB_NO_STATS
+  TEST_ASSERT_EQUAL_UINT64(2, st.dropped);
+#endif
+  queue_destroy(q);
+}
+
+void test_overflow_overwrite_ring() {
+  int v[10];
+  queue_t q = queue_init(4);
+  TEST_ASSERT_EQUAL_INT(0, queue_set_overflow(q, QUEUE_OVERWRITE, NULL, NULL));
+  for (int i = 0; i < 10; i++)
+    enqueue(q, &v[i]);
+  // only the newest four survive, still in order
+  for (int i = 6; i < 10; i++)
+    TEST_ASSERT_EQUAL_PTR(&v[i], dequeue(q));
+  TEST_ASSERT_TRUE(is_empty(q));
+  TEST_ASSERT_NULL(try_dequeue(q));
+  queue_stats_t st;
+  queue_stats(q, &st);
+#ifndef LAB_NO_STATS
+  TEST_ASSERT_EQUAL_UINT64(6, st.dropped);
+#endif
+  queue_shutdown(q);
+  TEST_ASSERT_EQUAL_INT(QUEUE_CLOSED, enqueue_status(q, &v[0]));
+  TEST_ASSERT_NULL(dequeue(q));
+#ifndef LAB_NO_STATS
+  // missing the lock-free pop is not a wait unless the consumer sleeps
+  queue_stats(q, &st);
+  TEST_ASSERT_EQUAL_UINT64(0, st.dequeue_blocked);
+  TEST_ASSERT_EQUAL_UINT64(0, st.dequeue_wait_ns);
+#endif
+  queue_destroy(q);
+}
+
+void test_enqueue_at_releases_by_deadline() {
+  queue_t q = queue_init(8);
+  int v[5];
+  uint64_t now = queue_now_ns();
+  uint64_t ms = 1000000;
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[0], now + 30 * ms));
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[1], now + 10 * ms));
+  // past level 0 of the wheel, so these cascade before expiring
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[2], now + 150 * ms));
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[3], now + 80 * ms));
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[4], now));
+  TEST_ASSERT_EQUAL_PTR(&v[4], dequeue(q));
+  TEST_ASSERT_NULL(try_dequeue(q));
+
+  TEST_ASSERT_EQUAL_PTR(&v[1], dequeue(q));
+  TEST_ASSERT_TRUE(queue_now_ns() >= now + 10 * ms);
+  TEST_ASSERT_EQUAL_PTR(&v[0], dequeue(q));
+  TEST_ASSERT_EQUAL_PTR(&v[3], dequeue(q));
+  TEST_ASSERT_EQUAL_PTR(&v[2], dequeue(q));
+  TEST_ASSERT_TRUE(queue_now_ns() >= now + 150 * ms);
+
+  // still pending at destroy: dropped, not leaked
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, &v[0], now + 3600000 * ms));
+  queue_shutdown(q);
+  TEST_ASSERT_EQUAL_INT(-1, enqueue_at(q, &v[0], now + 10 * ms));
+  queue_destroy(q);
+}
+
+void test_keyed_partition_ownership() {
+  keyed_queue_t q = keyed_queue_init(8, 4);
+  TEST_ASSERT_TRUE(q != NULL);
+  uint64_t k1 = 1, k2 = 2;
+  while (keyed_partition(q, k2) == keyed_partition(q, k1)) k2++;
+  int a = 1, b = 2, c = 3, p1, p2, p3;
+  enqueue_keyed(q, k1, &a);
+  enqueue_keyed(q, k1, &b);
+  enqueue_keyed(q, k2, &c);
+
+  TEST_ASSERT_EQUAL_PTR(&a, dequeue_keyed(q, &p1));
+  // k1's partition is owned, so the next consumer gets k2 instead of b
+  TEST_ASSERT_EQUAL_PTR(&c, dequeue_keyed(q, &p2));
+  TEST_ASSERT_EQUAL_INT(keyed_partition(q, k1), p1);
+  TEST_ASSERT_EQUAL_INT(keyed_partition(q, k2), p2);
+  keyed_release(q, p1);
+  TEST_ASSERT_EQUAL_PTR(&b, dequeue_keyed(q, &p3));
+  TEST_ASSERT_EQUAL_INT(p1, p3);
+
+  keyed_queue_shutdown(q);
+  keyed_release(q, p2);
+  keyed_release(q, p3);
+  TEST_ASSERT_NULL(dequeue_keyed(q, &p1));
+  keyed_queue_destroy(q);
+}
+
+static void *keep_larger(void *pending, void *incoming, void *ctx) {
+  (*(int *)ctx)++;
+  return *(int *)incoming > *(int *)pending ? incoming : pending;
+}
+
+void test_coalesce_merges_pending_keys() {
+  int merges = 0;
+  int v[4] = {10, 20, 5, 30};
+  coalesce_queue_t q = coalesce_queue_init(2, keep_larger, &merges);
+  TEST_ASSERT_TRUE(q != NULL);
+  TEST_ASSERT_FALSE(enqueue_coalesce(q, 7, &v[0]));
+  TEST_ASSERT_FALSE(enqueue_coalesce(q, 9, &v[1]));
+  // queue is full, but updates to pending keys never need a slot
+  TEST_ASSERT_TRUE(enqueue_coalesce(q, 7, &v[2]));
+  TEST_ASSERT_TRUE(enqueue_coalesce(q, 7, &v[3]));
+  TEST_ASSERT_EQUAL_INT(2, merges);
+  TEST_ASSERT_EQUAL_INT(2, coalesce_pending(q));
+
+  uint64_t key;
+  TEST_ASSERT_EQUAL_PTR(&v[3], dequeue_coalesce(q, &key));
+  TEST_ASSERT_EQUAL_UINT64(7, key);
+  TEST_ASSERT_FALSE(enqueue_coalesce(q, 7, &v[0]));
+  TEST_ASSERT_EQUAL_PTR(&v[1], dequeue_coalesce(q, &key));
+  TEST_ASSERT_EQUAL_UINT64(9, key);
+  coalesce_queue_shutdown(q);
+  TEST_ASSERT_EQUAL_PTR(&v[0], dequeue_coalesce(q, NULL));
+  TEST_ASSERT_NULL(dequeue_coalesce(q, NULL));
+  coalesce_queue_destroy(q);
+}
+
+static void remove_dir(const char *dir) {
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  char path[512];
+  while (d && (e = readdir(d))) {
+    if (e->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    unlink(path);
+  }
+  if (d) closedir(d);
+  rmdir(dir);
+}
+
+static int count_segments(const char *dir) {
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  int n = 0;
+  while (d && (e = readdir(d)))
+    n += strstr(e->d_name, ".log") != NULL;
+  if (d) closedir(d);
+  return n;
+}
+
+void test_wal_recovers_unconsumed_tail() {
+  char dir[] = "/tmp/test-wal-XXXXXX";
+  TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+  // tiny segments so every record rolls over to a new file
+  struct wal_options opts = {.segment_bytes = 1, .checkpoint_every = 1000};
+  wal_queue_t q = wal_queue_open(dir, &opts);
+  TEST_ASSERT_NOT_NULL(q);
+  const char *words[] = {"alpha", "beta", "gamma", "delta"};
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL_INT(0, wal_enqueue(q, words[i], strlen(words[i]) + 1));
+  TEST_ASSERT_EQUAL_INT(4, count_segments(dir));
+
+  size_t len;
+  char *item = wal_dequeue(q, &len);
+  TEST_ASSERT_EQUAL_STRING("alpha", item);
+  TEST_ASSERT_EQUAL_size_t(6, len);
+  free(item);
+  free(wal_dequeue(q, NULL));
+  TEST_ASSERT_EQUAL_INT(0, wal_checkpoint(q));
+  TEST_ASSERT_EQUAL_INT(2, count_segments(dir));
+  wal_queue_close(q);
+
+  // a torn write at the end of the log is cut off on recovery, even
+  // when its length field is garbage
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%020d.log", dir, 3);
+  FILE *f = fopen(path, "a");
+  uint32_t torn[4] = {0xffffffffu, 0, 4, 0};
+  fwrite(torn, sizeof(torn), 1, f);
+  fclose(f);
+
+  wal_queue_t r = wal_queue_open(dir, &opts);
+  TEST_ASSERT_NOT_NULL(r);
+  item = wal_dequeue(r, NULL);
+  TEST_ASSERT_EQUAL_STRING("gamma", item);
+  free(item);
+  TEST_ASSERT_EQUAL_INT(0, wal_enqueue(r, "epsilon", 8));
+  item = wal_dequeue(r, NULL);
+  TEST_ASSERT_EQUAL_STRING("delta", item);
+  free(item);
+  item = wal_dequeue(r, NULL);
+  TEST_ASSERT_EQUAL_STRING("epsilon", item);
+  free(item);
+  wal_queue_shutdown(r);
+  TEST_ASSERT_NULL(wal_dequeue(r, NULL));
+  wal_queue_close(r);
+  remove_dir(dir);
+}
+
+void test_spill_keeps_fifo_order() {
+  queue_t q = queue_init(4);
+  TEST_ASSERT_EQUAL_INT(0, queue_set_spill(q, "/tmp"));
+  // far more than the ring and one spill buffer hold, with no consumer
+  for (uintptr_t i = 1; i <= 10000; i++)
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_status(q, (void *)i));
+  void *batch[3] = {(void *)10001, (void *)10002, (void *)10003};
+  TEST_ASSERT_EQUAL_INT(3, enqueue_batch(q, batch, 3));
+
+  void *out[7];
+  TEST_ASSERT_EQUAL_INT(7, dequeue_batch(q, out, 7));
+  for (uintptr_t i = 0; i < 7; i++)
+    TEST_ASSERT_EQUAL_PTR((void *)(i + 1), out[i]);
+  for (uintptr_t i = 8; i <= 10003; i++)
+    TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+  TEST_ASSERT_TRUE(is_empty(q));
+
+  queue_stats_t st;
+  queue_stats(q, &st);
+#ifndef LAB_NO_STATS
+  TEST_ASSERT_EQUAL_UINT64(9999, st.spilled);
+  TEST_ASSERT_EQUAL_UINT64(10003, st.dequeued);
+#endif
+  queue_destroy(q);
+}
+
+// never more than 13 bytes, so values straddle reads
+static ssize_t short_read(int fd, void *buf, size_t n, off_t off) {
+  return pread(fd, buf, n < 13 ? n : 13, off);
+}
+
+static ssize_t failed_read(int fd, void *buf, size_t n, off_t off) {
+  (void)fd, (void)buf, (void)n, (void)off;
+  errno = EIO;
+  return -1;
+}
+
+void test_spill_read_faults() {
+  spill_t s = spill_open("/tmp", &queue_malloc_allocator);
+  TEST_ASSERT_NOT_NULL(s);
+  spill_set_reader(s, short_read);
+  // two full buffers reach the file, the rest stay in memory
+  for (uintptr_t i = 1; i <= 10000; i++)
+    TEST_ASSERT_EQUAL_INT(0, spill_push(s, (void *)i));
+  void *v;
+  for (uintptr_t i = 1; i <= 10000; i++) {
+    TEST_ASSERT_TRUE(spill_pop(s, &v));
+    TEST_ASSERT_EQUAL_PTR((void *)i, v);
+  }
+  TEST_ASSERT_FALSE(spill_pop(s, &v));
+  TEST_ASSERT_EQUAL_UINT64(0, spill_take_lost(s));
+
+  // a hard error gives up the file but not the buffered tail, and the
+  // count stays honest so a queue never waits on values it cannot get
+  spill_set_reader(s, failed_read);
+  for (uintptr_t i = 1; i <= 10000; i++)
+    TEST_ASSERT_EQUAL_INT(0, spill_push(s, (void *)i));
+  TEST_ASSERT_TRUE(spill_pop(s, &v));
+  TEST_ASSERT_EQUAL_PTR((void *)8193, v);
+  TEST_ASSERT_EQUAL_UINT64(8192, spill_take_lost(s));
+  TEST_ASSERT_EQUAL_UINT64(10000 - 8193, spill_count(s));
+  for (uintptr_t i = 8194; i <= 10000; i++) {
+    TEST_ASSERT_TRUE(spill_pop(s, &v));
+    TEST_ASSERT_EQUAL_PTR((void *)i, v);
+  }
+  TEST_ASSERT_EQUAL_UINT64(0, spill_count(s));
+
+  // and the file is usable again afterwards
+  spill_set_reader(s, NULL);
+  for (uintptr_t i = 1; i <= 5000; i++)
+    spill_push(s, (void *)i);
+  for (uintptr_t i = 1; i <= 5000; i++) {
+    TEST_ASSERT_TRUE(spill_pop(s, &v));
+    TEST_ASSERT_EQUAL_PTR((void *)i, v);
+  }
+  spill_close(s);
+}
+
+void test_mapped_ring_reattaches() {
+  char path[] = "/tmp/test-mapped-XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd >= 0);
+  close(fd);
+
+  queue_t q = queue_open_mapped(path, 4, QUEUE_MSYNC_NONE);
+  TEST_ASSERT_NOT_NULL(q);
+  // the file is locked while attached
+  TEST_ASSERT_NULL(queue_open_mapped(path, 4, QUEUE_MSYNC_NONE));
+  for (uintptr_t i = 1; i <= 4; i++)
+    enqueue(q, (void *)i);
+  TEST_ASSERT_EQUAL_PTR((void *)1, dequeue(q));
+  enqueue(q, (void *)5);  // wraps into the freed slot
+  TEST_ASSERT_EQUAL_INT(0, queue_msync(q));
+  queue_destroy(q);
+
+  TEST_ASSERT_NULL(queue_open_mapped(path, 8, QUEUE_MSYNC_NONE));
+  q = queue_open_mapped(path, 0, QUEUE_MSYNC_SYNC);
+  TEST_ASSERT_NOT_NULL(q);
+  for (uintptr_t i = 2; i <= 5; i++)
+    TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+  TEST_ASSERT_TRUE(is_empty(q));
+  TEST_ASSERT_EQUAL_INT(-1, queue_set_overflow(q, QUEUE_OVERWRITE, NULL, NULL));
+  // a batch that wraps around the end of the ring
+  enqueue(q, (void *)6);
+  void *batch[] = {(void *)7, (void *)8, (void *)9};
+  enqueue_batch(q, batch, 3);
+  queue_destroy(q);
+
+  q = queue_open_mapped(path, 4, QUEUE_MSYNC_ASYNC);
+  TEST_ASSERT_NOT_NULL(q);
+  for (uintptr_t i = 6; i <= 9; i++)
+    TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+  queue_destroy(q);
+  unlink(path);
+}
+
+void test_flags_ring_large_capacity() {
+  // 8MB ring: hugepage backed wherever the kernel allows it
+  size_t cap = (size_t)1 << 20;
+  queue_t q = queue_init_flags(cap, QUEUE_HUGEPAGES | QUEUE_PREFAULT);
+  TEST_ASSERT_NOT_NULL(q);
+  for (uintptr_t i = 1; i <= cap; i++)
+    enqueue(q, (void *)i);
+  TEST_ASSERT_EQUAL_PTR((void *)1, dequeue(q));
+  enqueue(q, (void *)(cap + 1));  // wraps into the freed slot
+  for (uintptr_t i = 2; i <= cap + 1; i++)
+    TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+  TEST_ASSERT_TRUE(is_empty(q));
+  queue_destroy(q);
+
+  q = queue_init_flags(3, QUEUE_PREFAULT | QUEUE_MLOCK);
+  TEST_ASSERT_NOT_NULL(q);
+  enqueue(q, (void *)1);
+  TEST_ASSERT_EQUAL_PTR((void *)1, dequeue(q));
+  queue_destroy(q);
+
+  TEST_ASSERT_NULL(queue_init_flags(0, 0));
+  TEST_ASSERT_NULL(queue_init_flags(SIZE_MAX, 0));
+}
+
+// counts what is outstanding, so every free must pair with an alloc
+typedef struct {
+  int live;
+  size_t bytes;
+} tally;
+
+static void *tally_alloc(size_t bytes, void *ctx) {
+  tally *t = ctx;
+  t->live++;
+  t->bytes += bytes;
+  return malloc(bytes);
+}
+
+static void tally_free(void *ptr, size_t bytes, void *ctx) {
+  tally *t = ctx;
+  t->live--;
+  t->bytes -= bytes;
+  free(ptr);
+}
+
+static void *tally_aligned_alloc(size_t align, size_t bytes, void *ctx) {
+  tally *t = ctx;
+  t->live++;
+  t->bytes += bytes;
+  return aligned_alloc(align, bytes);
+}
+
+void test_init_ex_uses_allocator() {
+  tally t = {0, 0};
+  queue_allocator_t a = {tally_alloc, tally_free, tally_aligned_alloc, &t};
+  queue_t q = queue_init_ex(8, &a);
+  TEST_ASSERT_NOT_NULL(q);
+  TEST_ASSERT_EQUAL_INT(2, t.live);  // struct and ring
+  TEST_ASSERT_EQUAL_INT(0, queue_set_overflow(q, QUEUE_OVERWRITE, NULL, NULL));
+  TEST_ASSERT_EQUAL_INT(3, t.live);
+  enqueue(q, (void *)1);
+  TEST_ASSERT_EQUAL_PTR((void *)1, dequeue(q));
+  queue_destroy(q);
+  TEST_ASSERT_EQUAL_INT(0, t.live);
+  TEST_ASSERT_EQUAL_size_t(0, t.bytes);
+
+  // the timing wheel and its node chunks come from the hooks too
+  q = queue_init_ex(8, &a);
+  TEST_ASSERT_EQUAL_INT(0, enqueue_at(q, (void *)2, queue_now_ns() + 1000000));
+  TEST_ASSERT_EQUAL_PTR((void *)2, dequeue(q));
+  TEST_ASSERT_TRUE(t.live > 2);
+  queue_destroy(q);
+  TEST_ASSERT_EQUAL_INT(0, t.live);
+  TEST_ASSERT_EQUAL_size_t(0, t.bytes);
+}
+
+void test_inplace_in_static_buffer() {
+  static char buf[8192];
+  size_t need = queue_required_size(4);
+  TEST_ASSERT_TRUE(need > 0 && need + 1 <= sizeof(buf));
+  TEST_ASSERT_NULL(queue_init_inplace(buf + 1, need - 1, 4));
+  TEST_ASSERT_EQUAL_size_t(0, queue_required_size(0));
+
+  // deliberately misaligned; destroy must leave the buffer alone
+  for (int round = 0; round < 2; round++) {
+    queue_t q = queue_init_inplace(buf + 1, need, 4);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_TRUE((char *)q >= buf + 1 && (char *)q < buf + 1 + need);
+    for (uintptr_t i = 1; i <= 4; i++)
+      enqueue(q, (void *)i);
+    TEST_ASSERT_EQUAL_PTR((void *)1, dequeue(q));
+    enqueue(q, (void *)5);
+    for (uintptr_t i = 2; i <= 5; i++)
+      TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+    queue_destroy(q);
+  }
+}
+
+#ifndef LAB_NO_STATS
+static void *dequeue_one(void *arg) {
+  return dequeue(arg);
+}
+
+static void *dequeue_batch_of_four(void *arg) {
+  void *got[4] = {NULL};
+  return dequeue_batch(arg, got, 4) == 1 ? got[0] : NULL;
+}
+
+// dequeue_blocked is counted under the lock once a consumer has parked
+static void wait_blocked(queue_t q, uint64_t dequeues) {
+  queue_stats_t st;
+  do {
+    sched_yield();
+    queue_stats(q, &st);
+  } while (st.dequeue_blocked < dequeues);
+}
+#endif
+
+void test_handoff_to_parked_consumer() {
+#ifndef LAB_NO_STATS
+  queue_t q = queue_init(4);
+  pthread_t t;
+  pthread_create(&t, NULL, dequeue_one, q);
+  wait_blocked(q, 1);
+  enqueue(q, (void *)7);
+  void *got;
+  pthread_join(t, &got);
+  TEST_ASSERT_EQUAL_PTR((void *)7, got);
+  TEST_ASSERT_TRUE(is_empty(q));
+  queue_stats_t st;
+  queue_stats(q, &st);
+  TEST_ASSERT_EQUAL_UINT64(1, st.handed_off);
+  TEST_ASSERT_EQUAL_UINT64(1, st.enqueued);
+  TEST_ASSERT_EQUAL_UINT64(1, st.dequeued);
+
+  // a parked batch dequeue gets the item handed to it, alone
+  pthread_create(&t, NULL, dequeue_batch_of_four, q);
+  wait_blocked(q, 2);
+  enqueue(q, (void *)8);
+  pthread_join(t, &got);
+  TEST_ASSERT_EQUAL_PTR((void *)8, got);
+  queue_stats(q, &st);
+  TEST_ASSERT_EQUAL_UINT64(2, st.handed_off);
+
+  // shutdown wakes a parked consumer empty-handed
+  pthread_create(&t, NULL, dequeue_one, q);
+  wait_blocked(q, 3);
+  queue_shutdown(q);
+  pthread_join(t, &got);
+  TEST_ASSERT_NULL(got);
+  queue_destroy(q);
+#else
+  TEST_IGNORE_MESSAGE("needs stats");
+#endif
+}
+
+#ifndef LAB_NO_STATS
+static void *enqueue_two(void *arg) {
+  enqueue(arg, (void *)2);
+  enqueue(arg, (void *)3);
+  return NULL;
+}
+#endif
+
+void test_enqueue_wait_max_is_longest_wait() {
+#ifndef LAB_NO_STATS
+  queue_t q = queue_init(1);
+  enqueue(q, (void *)1);
+  pthread_t t;
+  pthread_create(&t, NULL, enqueue_two, q);
+
+  // each enqueue in t is counted as blocked before it waits
+  queue_stats_t st;
+  for (uint64_t i = 1; i <= 2; i++) {
+    do {
+      sched_yield();
+      queue_stats(q, &st);
+    } while (st.enqueue_blocked < i);
+    TEST_ASSERT_EQUAL_PTR((void *)i, dequeue(q));
+  }
+  pthread_join(t, NULL);
+  TEST_ASSERT_EQUAL_PTR((void *)3, dequeue(q));
+
+  queue_stats(q, &st);
+  TEST_ASSERT_EQUAL_UINT64(2, st.enqueue_blocked);
+  TEST_ASSERT_TRUE(st.enqueue_wait_max_ns > 0);
+  TEST_ASSERT_TRUE(st.enqueue_wait_max_ns < st.enqueue_wait_ns);
+  queue_destroy(q);
+#else
+  TEST_IGNORE_MESSAGE("needs stats");
+#endif
+}
 
 int main(void) {
   UNITY_BEGIN();
@@ -124,5 +731,23 @@ int main(void) {
   RUN_TEST(test_shutdown_enqueue);
   RUN_TEST(test_wraparound);
   RUN_TEST(test_fill_destroy);
+  RUN_TEST(test_stats_counts);
+  RUN_TEST(test_batch_roundtrip);
+  RUN_TEST(test_numa_node_queue);
+  RUN_TEST(test_numa_hierarchical_drain);
+  RUN_TEST(test_overflow_reject_and_evict);
+  RUN_TEST(test_overflow_overwrite_ring);
+  RUN_TEST(test_enqueue_at_releases_by_deadline);
+  RUN_TEST(test_keyed_partition_ownership);
+  RUN_TEST(test_coalesce_merges_pending_keys);
+  RUN_TEST(test_wal_recovers_unconsumed_tail);
+  RUN_TEST(test_spill_keeps_fifo_order);
+  RUN_TEST(test_spill_read_faults);
+  RUN_TEST(test_mapped_ring_reattaches);
+  RUN_TEST(test_flags_ring_large_capacity);
+  RUN_TEST(test_init_ex_uses_allocator);
+  RUN_TEST(test_inplace_in_static_buffer);
+  RUN_TEST(test_handoff_to_parked_consumer);
+  RUN_TEST(test_enqueue_wait_max_is_longest_wait);
   return UNITY_END();
 }
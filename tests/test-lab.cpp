@@ -0,0 +1,156 @@
+#include <atomic>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include "harness/unity.h"
+#include "../src/lab.hpp"
+#include "../src/lab_coro.hpp"
+
+// Tests for the header-only C++ wrappers, built as their own binary since
+// they need C++20. Run with the C tests by make check.
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_queue_move_only_items() {
+  lab::queue<std::unique_ptr<int>, 4> q;
+  TEST_ASSERT_TRUE(q.push(std::make_unique<int>(1)));
+  TEST_ASSERT_TRUE(q.emplace(new int(2)));
+  std::optional<std::unique_ptr<int>> v = q.pop();
+  TEST_ASSERT_TRUE(v.has_value());
+  TEST_ASSERT_EQUAL_INT(1, **v);
+  // the destructor frees what is still queued; ASan would flag a leak
+  TEST_ASSERT_TRUE(q.push(std::make_unique<int>(3)));
+}
+
+void test_queue_span_batches() {
+  lab::queue<int, 4> q;
+  int in[6] = {1, 2, 3, 4, 5, 6};
+  // only as many as fit are taken
+  TEST_ASSERT_EQUAL_size_t(4, q.push(std::span<int>(in)));
+  int out[8] = {0};
+  TEST_ASSERT_EQUAL_size_t(4, q.pop(std::span<int>(out)));
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL_INT(i + 1, out[i]);
+  TEST_ASSERT_TRUE(q.is_empty());
+  TEST_ASSERT_EQUAL_size_t(0, q.push(std::span<int>(in, 0)));
+}
+
+void test_queue_drains_after_shutdown() {
+  lab::queue<int, 4> q;
+  q.push(1);
+  q.push(2);
+  q.shutdown();
+  TEST_ASSERT_TRUE(q.is_shutdown());
+  TEST_ASSERT_FALSE(q.push(3));
+  TEST_ASSERT_EQUAL_INT(1, *q.pop());
+  TEST_ASSERT_EQUAL_INT(2, *q.pop());
+  TEST_ASSERT_FALSE(q.pop().has_value());
+  int out[2];
+  TEST_ASSERT_EQUAL_size_t(0, q.pop(std::span<int>(out)));
+}
+
+static void push_then_shutdown(lab::queue<int, 2> &q, int n) {
+  for (int i = 1; i <= n; i++)
+    q.push(i);
+  q.shutdown();
+}
+
+void test_queue_blocks_when_full() {
+  lab::queue<int, 2> q;
+  std::thread producer(push_then_shutdown, std::ref(q), 1000);
+  int expect = 1;
+  while (std::optional<int> v = q.pop())
+    TEST_ASSERT_EQUAL_INT(expect++, *v);
+  producer.join();
+  TEST_ASSERT_EQUAL_INT(1001, expect);
+}
+
+// A detached coroutine runs up to its first real suspension before the
+// call returns, so each one below is parked on the queue by the time the
+// next line of the test runs.
+
+using coro_queue = lab::async_queue<int, 1>;
+
+static lab::detached pop_one(coro_queue &q, std::optional<int> &out, std::latch &done) {
+  out = co_await q.pop();
+  done.count_down();
+}
+
+static lab::detached push_one(coro_queue &q, int v, std::atomic<int> &ok, std::latch &done) {
+  ok += co_await q.push(v);
+  done.count_down();
+}
+
+void test_coro_push_hands_to_parked_popper() {
+  lab::scheduler sched(2);
+  coro_queue q(sched);
+  std::optional<int> got;
+  std::latch done(2);
+  pop_one(q, got, done);
+  std::atomic<int> ok{0};
+  push_one(q, 7, ok, done);  // finds the popper and never touches the ring
+  done.wait();
+  TEST_ASSERT_EQUAL_INT(1, ok.load());
+  TEST_ASSERT_TRUE(got.has_value());
+  TEST_ASSERT_EQUAL_INT(7, *got);
+  TEST_ASSERT_TRUE(q.is_empty());
+}
+
+void test_coro_pop_wakes_parked_pusher() {
+  lab::scheduler sched(2);
+  coro_queue q(sched);
+  std::atomic<int> ok{0};
+  std::latch pushed(2);
+  push_one(q, 1, ok, pushed);
+  push_one(q, 2, ok, pushed);  // full, so this one parks
+  TEST_ASSERT_EQUAL_INT(1, ok.load());
+
+  std::optional<int> first, second;
+  std::latch popped(2);
+  pop_one(q, first, popped);  // moves the parked item in and resumes its pusher
+  pushed.wait();
+  TEST_ASSERT_EQUAL_INT(2, ok.load());
+  pop_one(q, second, popped);
+  popped.wait();
+  TEST_ASSERT_EQUAL_INT(1, *first);
+  TEST_ASSERT_EQUAL_INT(2, *second);
+}
+
+void test_coro_shutdown_resumes_all_waiters() {
+  lab::scheduler sched(2);
+  coro_queue empty(sched), full(sched);
+  std::optional<int> a = 0, b = 0;
+  std::atomic<int> ok{0};
+  std::latch done(4);
+  pop_one(empty, a, done);
+  pop_one(empty, b, done);
+  push_one(full, 1, ok, done);  // fills the slot and finishes
+  push_one(full, 2, ok, done);  // parks
+  empty.shutdown();
+  full.shutdown();
+  done.wait();
+  TEST_ASSERT_FALSE(a.has_value());
+  TEST_ASSERT_FALSE(b.has_value());
+  TEST_ASSERT_EQUAL_INT(1, ok.load());
+  TEST_ASSERT_TRUE(full.is_shutdown());
+  TEST_ASSERT_FALSE(full.is_empty());  // still drainable after shutdown
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_queue_move_only_items);
+  RUN_TEST(test_queue_span_batches);
+  RUN_TEST(test_queue_drains_after_shutdown);
+  RUN_TEST(test_queue_blocks_when_full);
+  RUN_TEST(test_coro_push_hands_to_parked_popper);
+  RUN_TEST(test_coro_pop_wakes_parked_pusher);
+  RUN_TEST(test_coro_shutdown_resumes_all_waiters);
+  return UNITY_END();
+}